@@ -37,6 +37,7 @@
 #include <iterator>
 #include <algorithm>
 #include <memory>
+#include <new>
 #include <string>
 #include <vector>
 #include <array>
@@ -45,6 +46,43 @@
 #include <fstream>
 #include <sstream>
 #include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <chrono>
+#include <exception>
+#include <system_error>
+#include <cerrno>
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#  define PNM_HAS_POSIX_MMAP 1
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define PNM_HAS_SSE2 1
+#  include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#  define PNM_HAS_AVX2 1
+#  include <immintrin.h>
+#endif
+
+// 16-bit samples are stored in big endian in a file.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#  define PNM_BIG_ENDIAN 1
+#endif
 
 namespace pnm
 {
@@ -52,11 +90,14 @@ namespace pnm
 // --------------------------------------------------------------------------
 //                               * basic_pixel
 //          _            _         - basic_pixel<T, 1>
-//   _ __  (_)__  _ ___ | | ___    - basic_pixel<T, 3>
+//   _ __  (_)__  _ ___ | | ___    - basic_pixel<T, 2>, <T, 3>, <T, 4>
 //  | '_ \ | |\ \/ / _ \| |/ __| * aliases
 //  | |_) )| | )  (  __/| |\__ \   - bit_pixel for bitmap image
 //  | .__/ |_|/_/\_\___||_||___/   - gray_pixel for grayscale image
 //  |_|                            - pix_pixel for RGB color image
+//                                 - (gray|rgb)16_pixel for 16-bit image
+//                                 - (gray_alpha|rgba)(16)_pixel for pam
+//                                 - (gray|rgb)f_pixel for pfm
 //                               * literals
 // --------------------------------------------------------------------------
 template<typename T, std::size_t N>
@@ -187,12 +228,153 @@ inline bool operator>=(const basic_pixel<T, 3>& lhs, const basic_pixel<T, 3>& rh
     return !(lhs < rhs);
 }
 
+// gray + alpha, for pam images
+template<typename T>
+struct basic_pixel<T, 2>
+{
+  public:
+    using value_type = T;
+    static constexpr std::size_t colors = 2;
+
+    basic_pixel()  = default;
+    ~basic_pixel() = default;
+    basic_pixel(const basic_pixel&) = default;
+    basic_pixel(basic_pixel&&)      = default;
+    basic_pixel& operator=(const basic_pixel&) = default;
+    basic_pixel& operator=(basic_pixel&&)      = default;
+
+    basic_pixel(const value_type& V, const value_type& A)
+        noexcept(std::is_nothrow_copy_constructible<value_type>::value)
+        : value(V), alpha(A)
+    {}
+    basic_pixel(value_type&& V, value_type&& A)
+        noexcept(std::is_nothrow_move_constructible<value_type>::value)
+        : value(std::move(V)), alpha(std::move(A))
+    {}
+    basic_pixel(const std::array<value_type, 2>& values)
+        noexcept(std::is_nothrow_copy_constructible<value_type>::value)
+        : value(values[0]), alpha(values[1])
+    {}
+
+    value_type value;
+    value_type alpha;
+};
+template<typename T>
+constexpr std::size_t basic_pixel<T, 2>::colors;
+
+template<typename T>
+inline bool operator==(const basic_pixel<T, 2>& lhs, const basic_pixel<T, 2>& rhs) noexcept
+{
+    return lhs.value == rhs.value && lhs.alpha == rhs.alpha;
+}
+template<typename T>
+inline bool operator!=(const basic_pixel<T, 2>& lhs, const basic_pixel<T, 2>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+template<typename T>
+inline bool operator<(const basic_pixel<T, 2>& lhs, const basic_pixel<T, 2>& rhs) noexcept
+{
+    return std::array<T, 2>{{lhs.value, lhs.alpha}} <
+           std::array<T, 2>{{rhs.value, rhs.alpha}};
+}
+template<typename T>
+inline bool operator<=(const basic_pixel<T, 2>& lhs, const basic_pixel<T, 2>& rhs) noexcept
+{
+    return (lhs < rhs) || (lhs == rhs);
+}
+template<typename T>
+inline bool operator>(const basic_pixel<T, 2>& lhs, const basic_pixel<T, 2>& rhs) noexcept
+{
+    return !(lhs <= rhs);
+}
+template<typename T>
+inline bool operator>=(const basic_pixel<T, 2>& lhs, const basic_pixel<T, 2>& rhs) noexcept
+{
+    return !(lhs < rhs);
+}
+
+// rgb + alpha, for pam images
+template<typename T>
+struct basic_pixel<T, 4>
+{
+  public:
+    using value_type = T;
+    static constexpr std::size_t colors = 4;
+
+    basic_pixel()  = default;
+    ~basic_pixel() = default;
+    basic_pixel(const basic_pixel&) = default;
+    basic_pixel(basic_pixel&&)      = default;
+    basic_pixel& operator=(const basic_pixel&) = default;
+    basic_pixel& operator=(basic_pixel&&)      = default;
+
+    basic_pixel(const value_type& R, const value_type& G, const value_type& B,
+                const value_type& A)
+        noexcept(std::is_nothrow_copy_constructible<value_type>::value)
+        : red(R), green(G), blue(B), alpha(A)
+    {}
+    basic_pixel(value_type&& R, value_type&& G, value_type&& B, value_type&& A)
+        noexcept(std::is_nothrow_move_constructible<value_type>::value)
+        : red(std::move(R)), green(std::move(G)), blue(std::move(B)),
+          alpha(std::move(A))
+    {}
+    basic_pixel(const std::array<value_type, 4>& values)
+        noexcept(std::is_nothrow_copy_constructible<value_type>::value)
+        : red(values[0]), green(values[1]), blue(values[2]), alpha(values[3])
+    {}
+
+    value_type red;
+    value_type green;
+    value_type blue;
+    value_type alpha;
+};
+template<typename T>
+constexpr std::size_t basic_pixel<T, 4>::colors;
+
+template<typename T>
+inline bool operator==(const basic_pixel<T, 4>& lhs, const basic_pixel<T, 4>& rhs) noexcept
+{
+    return lhs.red == rhs.red && lhs.green == rhs.green && lhs.blue == rhs.blue && lhs.alpha == rhs.alpha;
+}
+template<typename T>
+inline bool operator!=(const basic_pixel<T, 4>& lhs, const basic_pixel<T, 4>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+template<typename T>
+inline bool operator<(const basic_pixel<T, 4>& lhs, const basic_pixel<T, 4>& rhs) noexcept
+{
+    return std::array<T, 4>{{lhs.red, lhs.green, lhs.blue, lhs.alpha}} <
+           std::array<T, 4>{{rhs.red, rhs.green, rhs.blue, rhs.alpha}};
+}
+template<typename T>
+inline bool operator<=(const basic_pixel<T, 4>& lhs, const basic_pixel<T, 4>& rhs) noexcept
+{
+    return (lhs < rhs) || (lhs == rhs);
+}
+template<typename T>
+inline bool operator>(const basic_pixel<T, 4>& lhs, const basic_pixel<T, 4>& rhs) noexcept
+{
+    return !(lhs <= rhs);
+}
+template<typename T>
+inline bool operator>=(const basic_pixel<T, 4>& lhs, const basic_pixel<T, 4>& rhs) noexcept
+{
+    return !(lhs < rhs);
+}
+
 using    bit_pixel = basic_pixel<bool,          1>;
 using   gray_pixel = basic_pixel<std::uint8_t,  1>;
 using    rgb_pixel = basic_pixel<std::uint8_t,  3>;
-// XXX not supported yet
-// using gray16_pixel = basic_pixel<std::uint16_t, 1>;
-// using  rgb16_pixel = basic_pixel<std::uint16_t, 3>;
+using gray16_pixel = basic_pixel<std::uint16_t, 1>;
+using  rgb16_pixel = basic_pixel<std::uint16_t, 3>;
+using gray_alpha_pixel   = basic_pixel<std::uint8_t,  2>;
+using       rgba_pixel   = basic_pixel<std::uint8_t,  4>;
+using gray_alpha16_pixel = basic_pixel<std::uint16_t, 2>;
+using       rgba16_pixel = basic_pixel<std::uint16_t, 4>;
+using        grayf_pixel = basic_pixel<float,         1>;
+using         rgbf_pixel = basic_pixel<float,         3>;
 
 
 template<typename T>
@@ -208,6 +390,22 @@ template<>
 struct is_narrowing_conversion< rgb_pixel,/* -> */ bit_pixel>: std::true_type{};
 template<>
 struct is_narrowing_conversion< rgb_pixel,/* -> */gray_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion<gray16_pixel,/* -> */ bit_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion< rgb16_pixel,/* -> */ bit_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion< rgb16_pixel,/* -> */gray_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion< rgb16_pixel,/* -> */gray16_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion<   rgb_pixel,/* -> */gray16_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion<  rgbf_pixel,/* -> */ grayf_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion< grayf_pixel,/* -> */  gray_pixel>: std::true_type{};
+template<>
+struct is_narrowing_conversion<  rgbf_pixel,/* -> */   rgb_pixel>: std::true_type{};
 
 namespace detail
 {
@@ -255,6 +453,247 @@ struct convert_impl<rgb_pixel, rgb_pixel>
 {
     static inline rgb_pixel invoke(rgb_pixel pixel) noexcept {return pixel;}
 };
+
+// 8-bit <-> 16-bit. [0, 255] is mapped to [0, 65535] by multiplying 257, and
+// the inverse conversion drops the lower byte.
+template<>
+struct convert_impl<bit_pixel, gray16_pixel>
+{
+    static inline gray16_pixel invoke(bit_pixel pixel) noexcept
+    {return (pixel.value) ? gray16_pixel(0) : gray16_pixel(65535);}
+};
+template<>
+struct convert_impl<bit_pixel, rgb16_pixel>
+{
+    static inline rgb16_pixel invoke(bit_pixel pixel) noexcept
+    {return (pixel.value) ? rgb16_pixel(0, 0, 0) : rgb16_pixel(65535, 65535, 65535);}
+};
+template<>
+struct convert_impl<gray_pixel, gray16_pixel>
+{
+    static inline gray16_pixel invoke(gray_pixel pixel) noexcept
+    {return gray16_pixel(static_cast<std::uint16_t>(pixel.value * 257u));}
+};
+template<>
+struct convert_impl<gray_pixel, rgb16_pixel>
+{
+    static inline rgb16_pixel invoke(gray_pixel pixel) noexcept
+    {
+        const std::uint16_t v = static_cast<std::uint16_t>(pixel.value * 257u);
+        return rgb16_pixel(v, v, v);
+    }
+};
+template<>
+struct convert_impl<rgb_pixel, rgb16_pixel>
+{
+    static inline rgb16_pixel invoke(rgb_pixel pixel) noexcept
+    {
+        return rgb16_pixel(static_cast<std::uint16_t>(pixel.red   * 257u),
+                           static_cast<std::uint16_t>(pixel.green * 257u),
+                           static_cast<std::uint16_t>(pixel.blue  * 257u));
+    }
+};
+template<>
+struct convert_impl<gray16_pixel, gray_pixel>
+{
+    static inline gray_pixel invoke(gray16_pixel pixel) noexcept
+    {return gray_pixel(static_cast<std::uint8_t>(pixel.value >> 8));}
+};
+template<>
+struct convert_impl<gray16_pixel, rgb_pixel>
+{
+    static inline rgb_pixel invoke(gray16_pixel pixel) noexcept
+    {
+        const std::uint8_t v = static_cast<std::uint8_t>(pixel.value >> 8);
+        return rgb_pixel(v, v, v);
+    }
+};
+template<>
+struct convert_impl<rgb16_pixel, rgb_pixel>
+{
+    static inline rgb_pixel invoke(rgb16_pixel pixel) noexcept
+    {
+        return rgb_pixel(static_cast<std::uint8_t>(pixel.red   >> 8),
+                         static_cast<std::uint8_t>(pixel.green >> 8),
+                         static_cast<std::uint8_t>(pixel.blue  >> 8));
+    }
+};
+template<>
+struct convert_impl<gray16_pixel, gray16_pixel>
+{
+    static inline gray16_pixel invoke(gray16_pixel pixel) noexcept {return pixel;}
+};
+template<>
+struct convert_impl<gray16_pixel, rgb16_pixel>
+{
+    static inline rgb16_pixel invoke(gray16_pixel pixel) noexcept
+    {return rgb16_pixel(pixel.value, pixel.value, pixel.value);}
+};
+template<>
+struct convert_impl<rgb16_pixel, rgb16_pixel>
+{
+    static inline rgb16_pixel invoke(rgb16_pixel pixel) noexcept {return pixel;}
+};
+
+// pixels with alpha channel. an opaque pixel is added alpha = max.
+template<>
+struct convert_impl<bit_pixel, gray_alpha_pixel>
+{
+    static inline gray_alpha_pixel invoke(bit_pixel pixel) noexcept
+    {return (pixel.value) ? gray_alpha_pixel(0, 255) : gray_alpha_pixel(255, 255);}
+};
+template<>
+struct convert_impl<bit_pixel, rgba_pixel>
+{
+    static inline rgba_pixel invoke(bit_pixel pixel) noexcept
+    {return (pixel.value) ? rgba_pixel(0, 0, 0, 255) : rgba_pixel(255, 255, 255, 255);}
+};
+template<>
+struct convert_impl<gray_pixel, gray_alpha_pixel>
+{
+    static inline gray_alpha_pixel invoke(gray_pixel pixel) noexcept
+    {return gray_alpha_pixel(pixel.value, 255);}
+};
+template<>
+struct convert_impl<gray_pixel, rgba_pixel>
+{
+    static inline rgba_pixel invoke(gray_pixel pixel) noexcept
+    {return rgba_pixel(pixel.value, pixel.value, pixel.value, 255);}
+};
+template<>
+struct convert_impl<rgb_pixel, rgba_pixel>
+{
+    static inline rgba_pixel invoke(rgb_pixel pixel) noexcept
+    {return rgba_pixel(pixel.red, pixel.green, pixel.blue, 255);}
+};
+template<>
+struct convert_impl<gray_alpha_pixel, gray_alpha_pixel>
+{
+    static inline gray_alpha_pixel invoke(gray_alpha_pixel pixel) noexcept {return pixel;}
+};
+template<>
+struct convert_impl<gray_alpha_pixel, rgba_pixel>
+{
+    static inline rgba_pixel invoke(gray_alpha_pixel pixel) noexcept
+    {return rgba_pixel(pixel.value, pixel.value, pixel.value, pixel.alpha);}
+};
+template<>
+struct convert_impl<rgba_pixel, rgba_pixel>
+{
+    static inline rgba_pixel invoke(rgba_pixel pixel) noexcept {return pixel;}
+};
+template<>
+struct convert_impl<gray_alpha16_pixel, gray_alpha16_pixel>
+{
+    static inline gray_alpha16_pixel invoke(gray_alpha16_pixel pixel) noexcept {return pixel;}
+};
+template<>
+struct convert_impl<gray16_pixel, gray_alpha16_pixel>
+{
+    static inline gray_alpha16_pixel invoke(gray16_pixel pixel) noexcept
+    {return gray_alpha16_pixel(pixel.value, 65535);}
+};
+template<>
+struct convert_impl<gray16_pixel, rgba16_pixel>
+{
+    static inline rgba16_pixel invoke(gray16_pixel pixel) noexcept
+    {return rgba16_pixel(pixel.value, pixel.value, pixel.value, 65535);}
+};
+template<>
+struct convert_impl<rgb16_pixel, rgba16_pixel>
+{
+    static inline rgba16_pixel invoke(rgb16_pixel pixel) noexcept
+    {return rgba16_pixel(pixel.red, pixel.green, pixel.blue, 65535);}
+};
+template<>
+struct convert_impl<gray_alpha16_pixel, rgba16_pixel>
+{
+    static inline rgba16_pixel invoke(gray_alpha16_pixel pixel) noexcept
+    {return rgba16_pixel(pixel.value, pixel.value, pixel.value, pixel.alpha);}
+};
+template<>
+struct convert_impl<rgba16_pixel, rgba16_pixel>
+{
+    static inline rgba16_pixel invoke(rgba16_pixel pixel) noexcept {return pixel;}
+};
+
+// floating point pixels. integer values are mapped into [0, 1].
+template<>
+struct convert_impl<grayf_pixel, grayf_pixel>
+{
+    static inline grayf_pixel invoke(grayf_pixel pixel) noexcept {return pixel;}
+};
+template<>
+struct convert_impl<rgbf_pixel, rgbf_pixel>
+{
+    static inline rgbf_pixel invoke(rgbf_pixel pixel) noexcept {return pixel;}
+};
+template<>
+struct convert_impl<grayf_pixel, rgbf_pixel>
+{
+    static inline rgbf_pixel invoke(grayf_pixel pixel) noexcept
+    {return rgbf_pixel(pixel.value, pixel.value, pixel.value);}
+};
+template<>
+struct convert_impl<bit_pixel, grayf_pixel>
+{
+    static inline grayf_pixel invoke(bit_pixel pixel) noexcept
+    {return grayf_pixel(pixel.value ? 0.0f : 1.0f);}
+};
+template<>
+struct convert_impl<bit_pixel, rgbf_pixel>
+{
+    static inline rgbf_pixel invoke(bit_pixel pixel) noexcept
+    {
+        const float v = pixel.value ? 0.0f : 1.0f;
+        return rgbf_pixel(v, v, v);
+    }
+};
+template<>
+struct convert_impl<gray_pixel, grayf_pixel>
+{
+    static inline grayf_pixel invoke(gray_pixel pixel) noexcept
+    {return grayf_pixel(pixel.value / 255.0f);}
+};
+template<>
+struct convert_impl<gray_pixel, rgbf_pixel>
+{
+    static inline rgbf_pixel invoke(gray_pixel pixel) noexcept
+    {
+        const float v = pixel.value / 255.0f;
+        return rgbf_pixel(v, v, v);
+    }
+};
+template<>
+struct convert_impl<rgb_pixel, rgbf_pixel>
+{
+    static inline rgbf_pixel invoke(rgb_pixel pixel) noexcept
+    {return rgbf_pixel(pixel.red / 255.0f, pixel.green / 255.0f, pixel.blue / 255.0f);}
+};
+template<>
+struct convert_impl<gray16_pixel, grayf_pixel>
+{
+    static inline grayf_pixel invoke(gray16_pixel pixel) noexcept
+    {return grayf_pixel(pixel.value / 65535.0f);}
+};
+template<>
+struct convert_impl<gray16_pixel, rgbf_pixel>
+{
+    static inline rgbf_pixel invoke(gray16_pixel pixel) noexcept
+    {
+        const float v = pixel.value / 65535.0f;
+        return rgbf_pixel(v, v, v);
+    }
+};
+template<>
+struct convert_impl<rgb16_pixel, rgbf_pixel>
+{
+    static inline rgbf_pixel invoke(rgb16_pixel pixel) noexcept
+    {
+        return rgbf_pixel(pixel.red  / 65535.0f, pixel.green / 65535.0f,
+                          pixel.blue / 65535.0f);
+    }
+};
 } // detail
 
 template<typename To, typename From>
@@ -268,19 +707,239 @@ convert_to(From&& pixel)
         >::invoke(std::forward<From>(pixel));
 }
 
-namespace literals
-{
-inline namespace pixel_literals
+// --------------------------------------------------------------------------
+// narrowing conversions (rgb -> gray, rgb -> bit, gray -> bit) throw by
+// default. passing a narrowing_policy to convert_to or convert_image enables
+// them. luminance is computed in 14-bit fixed point, and pixels darker than
+// the threshold become black.
+// --------------------------------------------------------------------------
+
+enum class luminance : std::uint8_t
 {
-inline bit_pixel operator"" _bit(unsigned long long x)
+    bt601, // Y = 0.299  R + 0.587  G + 0.114  B
+    bt709  // Y = 0.2126 R + 0.7152 G + 0.0722 B
+};
+
+struct narrowing_policy
 {
-    return bit_pixel(x != 0);
-}
-inline gray_pixel operator"" _gray(unsigned long long x)
+    constexpr explicit narrowing_policy(
+            const luminance coef = luminance::bt601,
+            const std::uint8_t thr = 128) noexcept
+        : coefficients(coef), threshold(thr)
+    {}
+
+    luminance    coefficients;
+    std::uint8_t threshold;
+};
+
+namespace detail
 {
-    return gray_pixel(static_cast<std::uint8_t>(x & 0xFFu));
-}
-inline rgb_pixel operator"" _rgb(unsigned long long x)
+struct luminance_weights
+{
+    // sum of the weights is 2^14.
+    explicit luminance_weights(const luminance coef) noexcept
+        : r(coef == luminance::bt601 ? 4899 :  3483),
+          g(coef == luminance::bt601 ? 9617 : 11718),
+          b(coef == luminance::bt601 ? 1868 :  1183)
+    {}
+    std::uint8_t operator()(const rgb_pixel& pix) const noexcept
+    {
+        return static_cast<std::uint8_t>(
+            (pix.red * r + pix.green * g + pix.blue * b + 8192u) >> 14u);
+    }
+    std::uint32_t r, g, b;
+};
+
+#ifdef PNM_HAS_SSE2
+// converts 32 interleaved rgb pixels (6 registers) into 3 planes of 16 bytes
+// x 2. five rounds of the same byte interleave restore the planar order.
+inline void deinterleave_rgb(__m128i (&v)[6]) noexcept
+{
+    for(int round=0; round<5; ++round)
+    {
+        const __m128i t[6] = {
+            _mm_unpacklo_epi8(v[0], v[3]), _mm_unpackhi_epi8(v[0], v[3]),
+            _mm_unpacklo_epi8(v[1], v[4]), _mm_unpackhi_epi8(v[1], v[4]),
+            _mm_unpacklo_epi8(v[2], v[5]), _mm_unpackhi_epi8(v[2], v[5])
+        };
+        std::copy(t, t + 6, v);
+    }
+    return;
+}
+
+// luminance of 8 pixels in 16-bit lanes.
+inline __m128i luminance8(const __m128i r, const __m128i g, const __m128i b,
+                          const __m128i wrg, const __m128i wb) noexcept
+{
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i lo = _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpacklo_epi16(r, g),   wrg),
+            _mm_madd_epi16(_mm_unpacklo_epi16(b, one), wb));
+    const __m128i hi = _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpackhi_epi16(r, g),   wrg),
+            _mm_madd_epi16(_mm_unpackhi_epi16(b, one), wb));
+    return _mm_packs_epi32(_mm_srli_epi32(lo, 14), _mm_srli_epi32(hi, 14));
+}
+#endif
+
+inline void rgb_to_gray(const rgb_pixel* src, gray_pixel* dst,
+                        const std::size_t n, const luminance coef) noexcept
+{
+    const luminance_weights w(coef);
+    std::size_t i = 0;
+#ifdef PNM_HAS_SSE2
+    const char* const in  = reinterpret_cast<const char*>(src);
+    char*       const out = reinterpret_cast<char*>(dst);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wrg  = _mm_set1_epi32(static_cast<int>((w.g << 16u) | w.r));
+    const __m128i wb   = _mm_set1_epi32(static_cast<int>((8192u << 16u) | w.b));
+    for(; i + 32 <= n; i += 32)
+    {
+        __m128i v[6];
+        for(std::size_t k=0; k<6; ++k)
+        {
+            v[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 3 + k * 16));
+        }
+        deinterleave_rgb(v); // R R G G B B
+        for(std::size_t k=0; k<2; ++k)
+        {
+            const __m128i lo = luminance8(_mm_unpacklo_epi8(v[k], zero),
+                    _mm_unpacklo_epi8(v[k+2], zero),
+                    _mm_unpacklo_epi8(v[k+4], zero), wrg, wb);
+            const __m128i hi = luminance8(_mm_unpackhi_epi8(v[k], zero),
+                    _mm_unpackhi_epi8(v[k+2], zero),
+                    _mm_unpackhi_epi8(v[k+4], zero), wrg, wb);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + k * 16),
+                             _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+    for(; i < n; ++i)
+    {
+        dst[i] = gray_pixel(w(src[i]));
+    }
+    return;
+}
+
+inline void gray_to_bit(const gray_pixel* src, bit_pixel* dst,
+                        const std::size_t n, const std::uint8_t threshold) noexcept
+{
+    std::size_t i = 0;
+    // black (1) if threshold - value does not saturate to 0.
+#ifdef PNM_HAS_SSE2
+    const char* const in  = reinterpret_cast<const char*>(src);
+    char*       const out = reinterpret_cast<char*>(dst);
+#endif
+#ifdef PNM_HAS_AVX2
+    {
+        const __m256i thr  = _mm256_set1_epi8(static_cast<char>(threshold));
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one  = _mm256_set1_epi8(1);
+        for(; i + 32 <= n; i += 32)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_andnot_si256(
+                _mm256_cmpeq_epi8(_mm256_subs_epu8(thr, v), zero), one));
+        }
+    }
+#endif
+#ifdef PNM_HAS_SSE2
+    {
+        const __m128i thr  = _mm_set1_epi8(static_cast<char>(threshold));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one  = _mm_set1_epi8(1);
+        for(; i + 16 <= n; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_andnot_si128(
+                _mm_cmpeq_epi8(_mm_subs_epu8(thr, v), zero), one));
+        }
+    }
+#endif
+    for(; i < n; ++i)
+    {
+        dst[i] = bit_pixel(src[i].value < threshold);
+    }
+    return;
+}
+
+// row-wise conversion that accepts a policy. pairs other than the narrowing
+// ones fall back to convert_impl.
+template<typename From, typename To>
+struct narrowing_impl
+{
+    static void invoke(const From* src, To* dst, const std::size_t n,
+                       const narrowing_policy&)
+    {
+        for(std::size_t i=0; i<n; ++i)
+        {
+            dst[i] = convert_impl<From, To>::invoke(src[i]);
+        }
+    }
+};
+template<>
+struct narrowing_impl<rgb_pixel, gray_pixel>
+{
+    static void invoke(const rgb_pixel* src, gray_pixel* dst,
+                       const std::size_t n, const narrowing_policy& policy) noexcept
+    {
+        return rgb_to_gray(src, dst, n, policy.coefficients);
+    }
+};
+template<>
+struct narrowing_impl<gray_pixel, bit_pixel>
+{
+    static void invoke(const gray_pixel* src, bit_pixel* dst,
+                       const std::size_t n, const narrowing_policy& policy) noexcept
+    {
+        return gray_to_bit(src, dst, n, policy.threshold);
+    }
+};
+template<>
+struct narrowing_impl<rgb_pixel, bit_pixel>
+{
+    static void invoke(const rgb_pixel* src, bit_pixel* dst,
+                       const std::size_t n, const narrowing_policy& policy) noexcept
+    {
+        // luminance is computed into a buffer on the stack, chunk by chunk.
+        std::array<gray_pixel, 1024> buf;
+        for(std::size_t i=0; i<n; i+=buf.size())
+        {
+            const std::size_t m = std::min(buf.size(), n - i);
+            rgb_to_gray(src + i, buf.data(), m, policy.coefficients);
+            gray_to_bit(buf.data(), dst + i, m, policy.threshold);
+        }
+    }
+};
+} // detail
+
+template<typename To, typename From>
+inline typename std::enable_if<is_pixel<typename std::remove_cv<
+    typename std::remove_reference<From>::type>::type>::value &&
+    is_pixel<To>::value, To>::type
+convert_to(From&& pixel, const narrowing_policy& policy)
+{
+    using from_type = typename std::remove_cv<
+        typename std::remove_reference<From>::type>::type;
+    const from_type src(pixel);
+    To dst;
+    detail::narrowing_impl<from_type, To>::invoke(&src, &dst, 1, policy);
+    return dst;
+}
+
+namespace literals
+{
+inline namespace pixel_literals
+{
+inline bit_pixel operator"" _bit(unsigned long long x)
+{
+    return bit_pixel(x != 0);
+}
+inline gray_pixel operator"" _gray(unsigned long long x)
+{
+    return gray_pixel(static_cast<std::uint8_t>(x & 0xFFu));
+}
+inline rgb_pixel operator"" _rgb(unsigned long long x)
 {
     const std::uint8_t R(static_cast<std::uint8_t>((x >> 16) & 0xFFu));
     const std::uint8_t G(static_cast<std::uint8_t>((x >>  8) & 0xFFu));
@@ -736,6 +1395,184 @@ struct const_line_proxy_iterator
     value_type  proxy_;
 };
 
+// line proxy for a buffer that is not owned by a std::vector, e.g. mmap-ed
+// memory. `T` can be const-qualified.
+template<typename T> struct pointer_line_proxy_iterator;
+
+template<typename T>
+struct pointer_line_proxy
+{
+    using pixel_type      = typename std::remove_const<T>::type;
+    using reference       = T&;
+    using const_reference = T const&;
+    using iterator        = T*;
+    using const_iterator  = T const*;
+
+    pointer_line_proxy(T* first, std::size_t iy, std::size_t nx) noexcept
+        : nx_(nx), iy_(iy), first_(first)
+    {}
+    ~pointer_line_proxy() = default;
+    pointer_line_proxy(const pointer_line_proxy&) = default;
+
+    // copies pixels, not the reference, as line_proxy does.
+    pointer_line_proxy& operator=(const pointer_line_proxy& other)
+    {
+        return this->assign(other.begin(), other.end(), other.width());
+    }
+    template<typename U>
+    pointer_line_proxy& operator=(const pointer_line_proxy<U>& other)
+    {
+        return this->assign(other.begin(), other.end(), other.width());
+    }
+    pointer_line_proxy& operator=(const std::vector<pixel_type>& other)
+    {
+        return this->assign(other.begin(), other.end(), other.size());
+    }
+
+    std::size_t width()      const noexcept {return nx_;}
+    std::size_t y_position() const noexcept {return iy_;}
+
+    reference operator[](const std::size_t i) const noexcept {return first_[i];}
+    reference at(const std::size_t i) const
+    {
+        if(nx_ <= i)
+        {
+            throw std::out_of_range("pnm::image::line_proxy::at: index (" +
+                std::to_string(i)   + std::string(") exceeds width(") +
+                std::to_string(nx_) + std::string(")"));
+        }
+        return first_[i];
+    }
+
+    iterator       begin()  const noexcept {return first_;}
+    iterator       end()    const noexcept {return first_ + nx_;}
+    const_iterator cbegin() const noexcept {return first_;}
+    const_iterator cend()   const noexcept {return first_ + nx_;}
+
+    bool operator==(const pointer_line_proxy& rhs) const noexcept
+    {
+        return this->nx_ == rhs.nx_ && this->first_ == rhs.first_;
+    }
+    bool operator!=(const pointer_line_proxy& rhs) const noexcept
+    {
+        return !(*this == rhs);
+    }
+
+  private:
+
+    template<typename Iterator>
+    pointer_line_proxy& assign(Iterator first, Iterator last, const std::size_t n)
+    {
+        if(this->nx_ != n)
+        {
+            throw std::out_of_range("pnm::image::line_proxy::copy this->width("+
+                std::to_string(this->nx_) + std::string(") differs from arg (")+
+                std::to_string(n) + std::string(")"));
+        }
+        std::copy(first, last, this->first_);
+        return *this;
+    }
+
+  private:
+
+    friend struct pointer_line_proxy_iterator<T>;
+
+    std::size_t nx_, iy_;
+    T*          first_;
+};
+
+template<typename T>
+struct pointer_line_proxy_iterator
+{
+    using value_type        = pointer_line_proxy<T>;
+    using reference         = value_type;
+    using pointer           = value_type const*;
+    using difference_type   = std::ptrdiff_t;
+    using iterator_category = std::random_access_iterator_tag;
+
+    pointer_line_proxy_iterator(T* first, std::size_t nx, std::size_t iy,
+                                std::size_t stride)
+        : stride_(stride), proxy_(first + stride * iy, iy, nx)
+    {}
+    ~pointer_line_proxy_iterator() = default;
+    pointer_line_proxy_iterator(const pointer_line_proxy_iterator&) = default;
+    pointer_line_proxy_iterator&
+    operator=(const pointer_line_proxy_iterator& rhs) noexcept
+    {
+        this->stride_       = rhs.stride_;
+        this->proxy_.nx_    = rhs.proxy_.nx_;
+        this->proxy_.iy_    = rhs.proxy_.iy_;
+        this->proxy_.first_ = rhs.proxy_.first_;
+        return *this;
+    }
+
+    value_type operator* () const noexcept {return value_type(this->proxy_);}
+    pointer    operator->() const noexcept {return std::addressof(this->proxy_);}
+
+    pointer_line_proxy_iterator& operator++() noexcept
+    {
+        proxy_.iy_    += 1;
+        proxy_.first_ += stride_;
+        return *this;
+    }
+    pointer_line_proxy_iterator& operator--() noexcept
+    {
+        proxy_.iy_    -= 1;
+        proxy_.first_ -= stride_;
+        return *this;
+    }
+    pointer_line_proxy_iterator operator++(int) noexcept
+    {
+        const auto tmp(*this); ++(*this); return tmp;
+    }
+    pointer_line_proxy_iterator operator--(int) noexcept
+    {
+        const auto tmp(*this); --(*this); return tmp;
+    }
+
+    pointer_line_proxy_iterator& operator+=(const difference_type d) noexcept
+    {
+        proxy_.iy_    += d;
+        proxy_.first_ += stride_ * d;
+        return *this;
+    }
+    pointer_line_proxy_iterator& operator-=(const difference_type d) noexcept
+    {
+        proxy_.iy_    -= d;
+        proxy_.first_ -= stride_ * d;
+        return *this;
+    }
+
+    bool operator==(const pointer_line_proxy_iterator& rhs) const noexcept
+    {
+        return this->proxy_ == rhs.proxy_;
+    }
+    bool operator!=(const pointer_line_proxy_iterator& rhs) const noexcept
+    {
+        return !(*this == rhs);
+    }
+    bool operator<(const pointer_line_proxy_iterator& rhs) const noexcept
+    {
+        return this->proxy_.first_ < rhs.proxy_.first_;
+    }
+    bool operator>(const pointer_line_proxy_iterator& rhs) const noexcept
+    {
+        return this->proxy_.first_ > rhs.proxy_.first_;
+    }
+    bool operator<=(const pointer_line_proxy_iterator& rhs) const noexcept
+    {
+        return this->proxy_.first_ <= rhs.proxy_.first_;
+    }
+    bool operator>=(const pointer_line_proxy_iterator& rhs) const noexcept
+    {
+        return this->proxy_.first_ >= rhs.proxy_.first_;
+    }
+
+  private:
+    std::size_t stride_;
+    value_type  proxy_;
+};
+
 template<typename Iterator>
 struct range
 {
@@ -939,13 +1776,35 @@ class image
     reference       raw_at(const std::size_t i)       {return pixels_.at(i);}
     const_reference raw_at(const std::size_t i) const {return pixels_.at(i);}
 
+    pointer       data()       noexcept {return pixels_.data();}
+    const_pointer data() const noexcept {return pixels_.data();}
+
+    // rows are not padded, so the stride is always the same as the width.
+    pointer       row_ptr(const std::size_t iy)       noexcept
+    {return pixels_.data() + iy * nx_;}
+    const_pointer row_ptr(const std::size_t iy) const noexcept
+    {return pixels_.data() + iy * nx_;}
+
     std::size_t width()  const noexcept {return nx_;}
     std::size_t height() const noexcept {return ny_;}
     std::size_t x_size() const noexcept {return nx_;}
     std::size_t y_size() const noexcept {return ny_;}
+    std::size_t stride() const noexcept {return nx_;}
 
     std::size_t size() const noexcept {return pixels_.size();}
 
+    // changes the size of the image. the pixels are not preserved as a 2D
+    // image. if the size does not change, nothing happens, and if the number
+    // of pixels does not grow, no memory is allocated.
+    void resize(const std::size_t width, const std::size_t height)
+    {
+        if(width == this->nx_ && height == this->ny_) {return;}
+        this->pixels_.resize(width * height);
+        this->nx_ = width;
+        this->ny_ = height;
+        return;
+    }
+
     iterator       begin()        noexcept {return pixels_.begin();}
     iterator       end()          noexcept {return pixels_.end();}
     const_iterator begin()  const noexcept {return pixels_.begin();}
@@ -981,7 +1840,7 @@ class image
     {return const_line_range(this->line_cbegin(), this->line_cend());}
 
   private:
-    std::size_t   nx_, ny_;
+    std::size_t   nx_ = 0, ny_ = 0;
     container_type pixels_;
 };
 
@@ -990,1025 +1849,4940 @@ using pgm_image = image<gray_pixel>;
 using ppm_image = image< rgb_pixel>;
 
 // --------------------------------------------------------------------------
-//    __                        _    * io functions and operators
-//   / _| ___  _ __ _ _ _  __ _| |_  * enum class format
-//  | |_ / _ \| '_/| ` ` \/ _` |  _| * operator<<(ostream, image)
-//  |  _| (_) | |  | | | | (_| | |_  * operator>>(ostream, image)
-//  |_|  \___/|_|  |_|_|_|\__,_|\__| * image read_*(filename)
-//                                   * void write_*(filenmae, image, format_flag = ascii)
+//         _                   * pnm::basic_image_view
+// __   __(_) ___ __      __     - a reference to a rectangular region
+// \ \ / /| |/ _ \\ \ /\ / /       - pointer, nx, ny, stride
+//  \ V / | |  __/ \ V  V /    * pnm::image_view
+//   \_/  |_|\___|  \_/\_/     * pnm::const_image_view
 // --------------------------------------------------------------------------
 
-enum class format: bool {ascii, binary};
+template<typename Pixel, std::size_t Alignment = 64>
+class aligned_image;
 
-namespace detail
-{
-// convert pixel value range [0, max] -> [0, 255]
-struct gain_base
-{
-    virtual ~gain_base() noexcept = default;
-    virtual std::uint8_t invoke(const std::size_t) const noexcept = 0;
-};
-struct identity final : gain_base
-{
-    identity() noexcept = default;
-    ~identity() noexcept override = default;
-    std::uint8_t invoke(const std::size_t x) const noexcept override
-    {return static_cast<std::uint8_t>(x);}
-};
-struct enlarge final : gain_base
+// a view does not own pixels. `T` is a (possibly const-qualified) pixel type.
+// `stride` is the distance between the first pixels of adjacent lines.
+template<typename T>
+class basic_image_view
 {
-    enlarge(const std::uint8_t max) noexcept: ratio(256 / (max+1)){}
-    ~enlarge() override = default;
+  public:
+    using pixel_type      = typename std::remove_const<T>::type;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using value_type      = pixel_type;
+    using pointer         = T*;
+    using const_pointer   = T const*;
+    using reference       = T&;
+    using const_reference = T const&;
+
+    using line_proxy                = detail::pointer_line_proxy<T>;
+    using const_line_proxy          = detail::pointer_line_proxy<T const>;
+    using line_proxy_iterator       = detail::pointer_line_proxy_iterator<T>;
+    using const_line_proxy_iterator = detail::pointer_line_proxy_iterator<T const>;
+    using line_range                = detail::range<line_proxy_iterator>;
+    using const_line_range          = detail::range<const_line_proxy_iterator>;
 
-    std::uint8_t invoke(const std::size_t x) const noexcept override
-    {
-        return static_cast<std::uint8_t>(x * ratio);
-    }
-    std::size_t ratio;
-};
-struct reduce final : gain_base
-{
-    reduce(const std::size_t max) noexcept: ratio(256.0 / (max+1.0)){}
-    ~reduce() override = default;
+    basic_image_view() noexcept
+        : nx_(0), ny_(0), stride_(0), first_(nullptr)
+    {}
+    ~basic_image_view() = default;
+    basic_image_view(const basic_image_view&) = default;
+    basic_image_view& operator=(const basic_image_view&) = default;
 
-    std::uint8_t invoke(const std::size_t x) const noexcept override
+    basic_image_view(pointer first, const std::size_t width,
+                     const std::size_t height) noexcept
+        : nx_(width), ny_(height), stride_(width), first_(first)
+    {}
+    basic_image_view(pointer first, const std::size_t width,
+                     const std::size_t height, const std::size_t stride)
+        : nx_(width), ny_(height), stride_(stride), first_(first)
     {
-        return static_cast<std::uint8_t>(x * ratio);
+        if(stride < width)
+        {
+            throw std::out_of_range("pnm::image_view: stride (" +
+                std::to_string(stride) + std::string(") is less than width (") +
+                std::to_string(width)  + std::string(")"));
+        }
     }
-    double ratio;
-};
-
-inline std::unique_ptr<gain_base> get_gain(const std::size_t max)
-{
-    if     (max == 255){return std::unique_ptr<identity>(new identity());}
-    else if(max >  255){return std::unique_ptr<reduce>  (new reduce(max));}
-    else               {return std::unique_ptr<enlarge> (new enlarge(max));}
-}
-
-namespace literals
-{
-inline std::string operator"" _str(const char* s, std::size_t len)
-{
-    return std::string(s, len);
-}
-} // literals
-} // detail
 
-// --------------------------------------------------------------------------
-//                     _   * read_(pbm|pgm|ppm)_(ascii|binary)
-//  _ __ ___  __ _  __| |    - the most specific functions
-// | '_// _ \/ _` |/ _` |  * read_(pbm|pgm|ppm)
-// | | (  __/ (_| | (_| |    - detects ascii or binary format and read
-// |_|  \___|\__,_|\__,_|  * read
-//                           - depends on what pixel you will specify
-// --------------------------------------------------------------------------
+    template<typename Alloc, typename U = T, typename std::enable_if<
+        !std::is_const<U>::value, std::nullptr_t>::type = nullptr>
+    basic_image_view(image<pixel_type, Alloc>& img) noexcept
+        : nx_(img.width()), ny_(img.height()), stride_(img.width()),
+          first_(img.data())
+    {}
+    template<typename Alloc, typename U = T, typename std::enable_if<
+        std::is_const<U>::value, std::nullptr_t>::type = nullptr>
+    basic_image_view(const image<pixel_type, Alloc>& img) noexcept
+        : nx_(img.width()), ny_(img.height()), stride_(img.width()),
+          first_(img.data())
+    {}
+    template<std::size_t Alignment, typename U = T, typename std::enable_if<
+        !std::is_const<U>::value, std::nullptr_t>::type = nullptr>
+    basic_image_view(aligned_image<pixel_type, Alignment>& img) noexcept
+        : nx_(img.width()), ny_(img.height()), stride_(img.stride()),
+          first_(img.data())
+    {}
+    template<std::size_t Alignment, typename U = T, typename std::enable_if<
+        std::is_const<U>::value, std::nullptr_t>::type = nullptr>
+    basic_image_view(const aligned_image<pixel_type, Alignment>& img) noexcept
+        : nx_(img.width()), ny_(img.height()), stride_(img.stride()),
+          first_(img.data())
+    {}
 
-template<typename Alloc = std::allocator<bit_pixel>>
-image<bit_pixel, Alloc> read_pbm_ascii(const std::string& fname)
-{
-    using namespace detail::literals;
+    // image_view -> const_image_view
+    template<typename U, typename std::enable_if<
+        std::is_same<U const, T>::value && !std::is_same<U, T>::value,
+        std::nullptr_t>::type = nullptr>
+    basic_image_view(const basic_image_view<U>& other) noexcept
+        : nx_(other.width()), ny_(other.height()), stride_(other.stride()),
+          first_(other.row_ptr(0))
+    {}
 
-    std::ifstream ifs(fname);
-    if(!ifs.good())
+    basic_image_view subview(const std::size_t x, const std::size_t y,
+        const std::size_t width, const std::size_t height) const
     {
-        throw std::runtime_error(
-                "pnm::read_pbm_ascii: file open error: "_str + fname);
+        if(this->nx_ < x + width || this->ny_ < y + height)
+        {
+            throw std::out_of_range("pnm::image_view::subview: region (" +
+                std::to_string(x)     + std::string(", ") +
+                std::to_string(y)     + std::string(", ") +
+                std::to_string(width) + std::string("x")  +
+                std::to_string(height)+ std::string(") exceeds the view (") +
+                std::to_string(nx_)   + std::string("x")  +
+                std::to_string(ny_)   + std::string(")"));
+        }
+        return basic_image_view(first_ + x + y * stride_, width, height, stride_);
     }
 
+    line_proxy operator[](const std::size_t i) const noexcept
+    {
+        return line_proxy(this->row_ptr(i), i, nx_);
+    }
+    line_proxy at(const std::size_t i) const
     {
-        char desc[2] = {'\0', '\0'};
-        ifs.read(desc, 2);
-        if(!(desc[0] == 'P' && desc[1] == '1'))
+        if(this->ny_ <= i)
         {
-            throw std::runtime_error("pnm::read_pbm_ascii: " + fname +
-                " is not a pbm file: magic number is "_str +
-                std::string{desc[0], desc[1]});
+            throw std::out_of_range("pnm::image_view::at index(" +
+                std::to_string(i) + std::string(") exceeds height (") +
+                std::to_string(this->ny_) + std::string(")"));
         }
+        return (*this)[i];
     }
 
-    bool        x_read(false), y_read(false);
-    std::size_t x(0),          y(0);
-    while(!ifs.eof())
+    reference operator()(const std::size_t ix, const std::size_t iy) const noexcept
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
-
-        std::size_t tmp;
-        std::istringstream iss(line);
-        while(!iss.eof())
-        {
-            iss >> tmp;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_pbm_ascii: file " +
-                        fname + " contains invalid token: "_str + dummy);
-                }
-            }
-            else
-            {
-                if(!x_read){x = tmp; x_read = true; continue;}
-                if(!y_read){y = tmp; y_read = true; continue;}
-            }
-        }
-        if(x_read && y_read)
+        return first_[ix + iy * stride_];
+    }
+    reference at(const std::size_t ix, const std::size_t iy) const
+    {
+        if(this->nx_ <= ix || this->ny_ <= iy)
         {
-            break;
+            throw std::out_of_range("pnm::image_view::at index(" +
+                std::to_string(ix) + std::string(", ") + std::to_string(iy) +
+                std::string(") exceeds image size"));
         }
+        return first_[ix + iy * stride_];
     }
 
-    image<bit_pixel, Alloc> img(x, y);
-
-    std::size_t idx=0;
-    while(!ifs.eof())
+    pointer row_ptr(const std::size_t iy) const noexcept
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
+        return first_ + iy * stride_;
+    }
+
+    std::size_t width()  const noexcept {return nx_;}
+    std::size_t height() const noexcept {return ny_;}
+    std::size_t x_size() const noexcept {return nx_;}
+    std::size_t y_size() const noexcept {return ny_;}
+    std::size_t stride() const noexcept {return stride_;}
+
+    std::size_t size() const noexcept {return nx_ * ny_;}
+
+    // true if there is no gap between lines
+    bool is_contiguous() const noexcept {return nx_ == stride_ || ny_ <= 1;}
+
+    line_proxy_iterator line_begin() const noexcept
+    {return line_proxy_iterator(first_, nx_, 0, stride_);}
+    line_proxy_iterator line_end()   const noexcept
+    {return line_proxy_iterator(first_, nx_, ny_, stride_);}
+
+    const_line_proxy_iterator line_cbegin() const noexcept
+    {return const_line_proxy_iterator(first_, nx_, 0, stride_);}
+    const_line_proxy_iterator line_cend()   const noexcept
+    {return const_line_proxy_iterator(first_, nx_, ny_, stride_);}
+
+    line_range lines() const noexcept
+    {return line_range(this->line_begin(), this->line_end());}
+
+  private:
+    std::size_t nx_, ny_, stride_;
+    pointer     first_;
+};
 
-        int pix;
-        std::istringstream iss(line);
-        while(!iss.eof())
+template<typename Pixel>
+using image_view = basic_image_view<Pixel>;
+template<typename Pixel>
+using const_image_view = basic_image_view<Pixel const>;
+
+// --------------------------------------------------------------------------
+//        _ _                      _  * pnm::aligned_allocator
+//   __ _| (_) __ _ _ __   ___  __| |   - aligns the storage to N bytes
+//  / _` | | |/ _` | '_ \ / _ \/ _` | * pnm::aligned_image
+// | (_| | | | (_| | | | |  __/ (_| |   - every row starts at N-byte boundary
+//  \__,_|_|_|\__, |_| |_|\___|\__,_|   - nx, ny, stride
+//            |___/
+// --------------------------------------------------------------------------
+
+// an allocator that returns memory aligned to `Alignment` bytes. it
+// over-allocates and stores the original address right before the block.
+template<typename T, std::size_t Alignment>
+class aligned_allocator
+{
+    static_assert(Alignment != 0 && (Alignment & (Alignment - 1)) == 0,
+                  "pnm::aligned_allocator: alignment must be a power of 2");
+    static_assert(Alignment >= alignof(T) && Alignment >= alignof(void*),
+                  "pnm::aligned_allocator: alignment is too small");
+
+  public:
+    using value_type = T;
+    template<typename U>
+    struct rebind {using other = aligned_allocator<U, Alignment>;};
+
+    aligned_allocator() noexcept = default;
+    template<typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept {}
+
+    T* allocate(const std::size_t n)
+    {
+        constexpr std::size_t extra = Alignment - 1 + sizeof(void*);
+        if(n > (std::numeric_limits<std::size_t>::max() - extra) / sizeof(T))
         {
-            iss >> pix;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_pbm_ascii: "
-                        "file contains invalid token: " + dummy);
-                }
-            }
-            else
-            {
-                if(idx >= x * y)
-                {
-                    throw std::runtime_error("pnm::read_pbm_ascii: file "  +
-                        fname + " contains too many pixels: "_str +
-                        std::to_string(idx) + " pixels for "_str  +
-                        std::to_string(x)   + "x"_str             +
-                        std::to_string(y)   + " image"_str);
-                }
-                img.raw_access(idx++) = bit_pixel(pix != 0);
-            }
+            throw std::bad_alloc();
         }
+        void* const raw = ::operator new(n * sizeof(T) + extra);
+        const std::uintptr_t addr =
+            (reinterpret_cast<std::uintptr_t>(raw) + extra) &
+            ~static_cast<std::uintptr_t>(Alignment - 1);
+        reinterpret_cast<void**>(addr)[-1] = raw;
+        return reinterpret_cast<T*>(addr);
     }
-    return img;
-}
-template<typename Alloc = std::allocator<bit_pixel>>
-image<bit_pixel, Alloc> read_pbm_binary(const std::string& fname)
-{
-    using namespace detail::literals;
-    std::ifstream ifs(fname, std::ios::binary);
-    if(!ifs.good())
+    void deallocate(T* p, const std::size_t) noexcept
     {
-        throw std::runtime_error(
-                "pnm::read_pbm_binary: file open error: " + fname);
+        ::operator delete(reinterpret_cast<void**>(p)[-1]);
     }
+};
+template<typename T, typename U, std::size_t Alignment>
+bool operator==(const aligned_allocator<T, Alignment>&,
+                const aligned_allocator<U, Alignment>&) noexcept
+{
+    return true;
+}
+template<typename T, typename U, std::size_t Alignment>
+bool operator!=(const aligned_allocator<T, Alignment>&,
+                const aligned_allocator<U, Alignment>&) noexcept
+{
+    return false;
+}
+
+namespace detail
+{
+constexpr std::size_t gcd(const std::size_t a, const std::size_t b) noexcept
+{
+    return b == 0 ? a : gcd(b, a % b);
+}
+} // detail
 
+// an image whose rows start at `Alignment`-byte boundaries. rows are padded
+// up to `stride` pixels, so that SIMD kernels can load whole aligned vectors
+// without copying the image. the padding pixels are not a part of the image.
+template<typename Pixel, std::size_t Alignment>
+class aligned_image
+{
+  public:
+    using pixel_type      = Pixel;
+    using allocator_type  = aligned_allocator<Pixel, Alignment>;
+    using container_type  = std::vector<pixel_type, allocator_type>;
+    using pointer         = pixel_type*;
+    using const_pointer   = pixel_type const*;
+    using reference       = pixel_type&;
+    using const_reference = pixel_type const&;
+
+    static constexpr std::size_t alignment = Alignment;
+
+    aligned_image() = default;
+    ~aligned_image() = default;
+    aligned_image(const aligned_image&) = default;
+    aligned_image(aligned_image&&)      = default;
+    aligned_image& operator=(const aligned_image&) = default;
+    aligned_image& operator=(aligned_image&&)      = default;
+
+    aligned_image(const std::size_t width, const std::size_t height)
+        : nx_(width), ny_(height), stride_(min_stride(width)),
+          pixels_(stride_ * height)
+    {}
+    aligned_image(const std::size_t width, const std::size_t height,
+                  const pixel_type& pix)
+        : nx_(width), ny_(height), stride_(min_stride(width)),
+          pixels_(stride_ * height, pix)
+    {}
+    // `stride` is in pixels. it should not be less than `width`, and a row
+    // of `stride` pixels should be a multiple of `Alignment` bytes.
+    aligned_image(const std::size_t width, const std::size_t height,
+                  const std::size_t stride)
+        : nx_(width), ny_(height), stride_(stride), pixels_()
     {
-        char desc[2] = {'\0', '\0'};
-        ifs.read(desc, 2);
-        if(!(desc[0] == 'P' && desc[1] == '4'))
+        if(stride < width || (stride * sizeof(pixel_type)) % Alignment != 0)
         {
-            throw std::runtime_error("pnm::read_pbm_binary: " + fname +
-                " is not a binary pbm file: magic number is "_str +
-                std::string{desc[0], desc[1]});
+            throw std::out_of_range("pnm::aligned_image: stride (" +
+                std::to_string(stride) + std::string(") is less than width (") +
+                std::to_string(width) + std::string(") or does not keep rows "
+                "aligned to ") + std::to_string(Alignment) + " bytes");
         }
+        pixels_.resize(stride_ * height);
     }
 
-    bool        x_read(false), y_read(false);
-    std::size_t x(0),          y(0);
-    while(!ifs.eof())
+    explicit aligned_image(const const_image_view<pixel_type>& view)
+        : aligned_image(view.width(), view.height())
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
-
-        std::size_t tmp;
-        std::istringstream iss(line);
-        while(!iss.eof())
-        {
-            iss >> tmp;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_pbm_ascii: file " +
-                        fname + " contains invalid token: "_str + dummy);
-                }
-            }
-            else
-            {
-                if(!x_read){x = tmp; x_read = true; continue;}
-                if(!y_read){y = tmp; y_read = true; continue;}
-            }
-        }
-        if(x_read && y_read)
+        for(std::size_t j=0; j<ny_; ++j)
         {
-            break;
+            std::copy(view.row_ptr(j), view.row_ptr(j) + nx_, this->row_ptr(j));
         }
     }
+    template<typename Alloc>
+    explicit aligned_image(const image<pixel_type, Alloc>& img)
+        : aligned_image(const_image_view<pixel_type>(img))
+    {}
 
-    image<bit_pixel, Alloc> img(x, y);
-
-    const std::size_t quot = x >> 3u;
-    const std::size_t rem  = x &  7u;
-
-    for(std::size_t j=0; j<y; ++j)
+    // the least stride that is not less than `width` and keeps the alignment.
+    static constexpr std::size_t min_stride(const std::size_t width) noexcept
     {
-        for(std::size_t i=0; i<quot; ++i)
-        {
-            std::uint8_t v(0);
-            ifs.read(reinterpret_cast<char*>(&v), 1);
-            img(i*8 + 0, j) = bit_pixel((v & 0x80) == 0x80);
-            img(i*8 + 1, j) = bit_pixel((v & 0x40) == 0x40);
-            img(i*8 + 2, j) = bit_pixel((v & 0x20) == 0x20);
-            img(i*8 + 3, j) = bit_pixel((v & 0x10) == 0x10);
-            img(i*8 + 4, j) = bit_pixel((v & 0x08) == 0x08);
-            img(i*8 + 5, j) = bit_pixel((v & 0x04) == 0x04);
-            img(i*8 + 6, j) = bit_pixel((v & 0x02) == 0x02);
-            img(i*8 + 7, j) = bit_pixel((v & 0x01) == 0x01);
-        }
-        if (rem == 0) { continue; }
-        std::uint8_t v(0);
-        ifs.read(reinterpret_cast<char*>(&v), 1);
-        for(std::size_t r=0; r<rem; ++r)
-        {
-            const std::size_t mask = (1 << (7-r));
-            img(quot*8 + r, j) = bit_pixel((v & mask) == mask);
-        }
+        return (width + step() - 1) / step() * step();
     }
-    return img;
-}
 
-template<typename Alloc = std::allocator<bit_pixel>>
-image<bit_pixel, Alloc> read_pbm(const std::string& fname)
-{
-    using namespace detail::literals;
-    char descripter[2];
+    reference operator()(const std::size_t ix, const std::size_t iy) noexcept
     {
-        std::ifstream ifs(fname, std::ios::binary);
-        ifs.read(descripter, 2);
+        return pixels_[ix + iy * stride_];
     }
-
-    if(descripter[0] == 'P' && descripter[1] == '1')
+    const_reference
+    operator()(const std::size_t ix, const std::size_t iy) const noexcept
     {
-        return read_pbm_ascii(fname);
+        return pixels_[ix + iy * stride_];
     }
-    else if(descripter[0] == 'P' && descripter[1] == '4')
+    reference at(const std::size_t ix, const std::size_t iy)
     {
-        return read_pbm_binary(fname);
+        this->check_index(ix, iy);
+        return pixels_[ix + iy * stride_];
+    }
+    const_reference at(const std::size_t ix, const std::size_t iy) const
+    {
+        this->check_index(ix, iy);
+        return pixels_[ix + iy * stride_];
     }
-    throw std::runtime_error("pnm::read_pbm: not a pbm file: magic number is " +
-                             std::string{descripter[0], descripter[1]});
-}
 
-template<typename Alloc = std::allocator<gray_pixel>>
-image<gray_pixel, Alloc> read_pgm_ascii(const std::string& fname)
-{
-    using namespace detail::literals;
-    std::ifstream ifs(fname);
-    if(!ifs.good())
+    pointer       row_ptr(const std::size_t iy)       noexcept
+    {return pixels_.data() + iy * stride_;}
+    const_pointer row_ptr(const std::size_t iy) const noexcept
+    {return pixels_.data() + iy * stride_;}
+
+    pointer       data()       noexcept {return pixels_.data();}
+    const_pointer data() const noexcept {return pixels_.data();}
+
+    std::size_t width()  const noexcept {return nx_;}
+    std::size_t height() const noexcept {return ny_;}
+    std::size_t x_size() const noexcept {return nx_;}
+    std::size_t y_size() const noexcept {return ny_;}
+    std::size_t stride() const noexcept {return stride_;}
+    std::size_t size()   const noexcept {return nx_ * ny_;}
+
+    // changes the size of the image with the least stride. the pixels are not
+    // preserved. if the size does not change, nothing happens.
+    void resize(const std::size_t width, const std::size_t height)
     {
-        throw std::runtime_error(
-                "pnm::read_pgm_ascii: file open error: " + fname);
+        if(width == this->nx_ && height == this->ny_) {return;}
+        this->stride_ = min_stride(width);
+        this->pixels_.resize(this->stride_ * height);
+        this->nx_ = width;
+        this->ny_ = height;
+        return;
+    }
+
+  private:
+
+    // the number of pixels that makes a multiple of `Alignment` bytes.
+    static constexpr std::size_t step() noexcept
+    {
+        return Alignment / detail::gcd(Alignment, sizeof(pixel_type));
     }
 
+    void check_index(const std::size_t ix, const std::size_t iy) const
     {
-        char desc[2] = {'\0', '\0'};
-        ifs.read(desc, 2);
-        if(!(desc[0] == 'P' && desc[1] == '2'))
+        if(this->nx_ <= ix || this->ny_ <= iy)
         {
-            throw std::runtime_error("pnm::read_pgm_ascii: " + fname +
-                "not a pgm file: magic number is "_str +
-                std::string{desc[0], desc[1]});
+            throw std::out_of_range("pnm::aligned_image::at: index (" +
+                std::to_string(ix) + std::string(", ") + std::to_string(iy) +
+                std::string(") exceeds image size (") + std::to_string(nx_) +
+                std::string("x") + std::to_string(ny_) + std::string(")"));
         }
     }
 
-    bool        x_read(false), y_read(false), max_read(false);
-    std::size_t x(0),          y(0),          max(0);
-    while(!ifs.eof())
+  private:
+    std::size_t    nx_ = 0, ny_ = 0, stride_ = 0;
+    container_type pixels_;
+};
+template<typename Pixel, std::size_t Alignment>
+constexpr std::size_t aligned_image<Pixel, Alignment>::alignment;
+
+// --------------------------------------------------------------------------
+// executor runs the tasks of the parallel functions. thread_pool is used by
+// default, and an application can pass its own executor via parallel_policy
+// to limit the number of threads.
+// --------------------------------------------------------------------------
+
+// runs the tasks of parallel functions. implement this to run them on a
+// thread pool that the application already owns.
+class executor
+{
+  public:
+    virtual ~executor() = default;
+
+    // the number of tasks that can run at the same time.
+    virtual std::size_t concurrency() const noexcept = 0;
+
+    // calls `task(i)` for i in [0, n) and returns after all of them finish.
+    // `task` does not throw. `execute` may be called from inside a task.
+    virtual void execute(const std::size_t n,
+                         const std::function<void(std::size_t)>& task) = 0;
+};
+
+// runs all the tasks on the calling thread.
+class inline_executor final : public executor
+{
+  public:
+    std::size_t concurrency() const noexcept override {return 1;}
+
+    void execute(const std::size_t n,
+                 const std::function<void(std::size_t)>& task) override
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
+        for(std::size_t i=0; i<n; ++i) {task(i);}
+        return;
+    }
+};
 
-        std::size_t tmp;
-        std::istringstream iss(line);
-        while(!iss.eof())
+// a fixed number of worker threads. the calling thread of `execute` also runs
+// the tasks until all of them are taken, so a nested `execute` never waits
+// for a task that no thread can start.
+class thread_pool final : public executor
+{
+  public:
+    // `threads == 0` means std::thread::hardware_concurrency().
+    explicit thread_pool(const std::size_t threads = 0)
+        : stop_(false)
+    {
+        const std::size_t n = (threads != 0) ? threads :
+            std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        workers_.reserve(n - 1);
+        for(std::size_t i=1; i<n; ++i)
         {
-            iss >> tmp;
-            if(iss.fail())
+            try
             {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_pgm_ascii: file " +
-                        fname + " contains invalid token: "_str  + dummy);
-                }
+                workers_.emplace_back([this]() noexcept {this->work();});
             }
-            else
+            catch(const std::system_error&)
             {
-                if(  !x_read){  x = tmp;   x_read = true; continue;}
-                if(  !y_read){  y = tmp;   y_read = true; continue;}
-                if(!max_read){max = tmp; max_read = true; continue;}
+                break; // the tasks run on fewer threads
             }
         }
-        if(x_read && y_read && max_read)
+    }
+    ~thread_pool() noexcept override
+    {
         {
-            break;
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
         }
+        cv_.notify_all();
+        for(auto& worker : workers_) {worker.join();}
     }
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
 
-    image<gray_pixel, Alloc> img(x, y);
-    const auto gain = detail::get_gain(max);
-
-    std::size_t idx=0;
-    while(!ifs.eof())
+    std::size_t concurrency() const noexcept override
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
+        return workers_.size() + 1;
+    }
 
-        std::size_t pix;
-        std::istringstream iss(line);
-        while(!iss.eof())
+    void execute(const std::size_t n,
+                 const std::function<void(std::size_t)>& task) override
+    {
+        if(n == 0) {return;}
+        const auto j = std::make_shared<job>(task, n);
+        if(n != 1 && !workers_.empty())
         {
-            iss >> pix;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_pgm_ascii: file " +
-                        fname + " contains invalid token: "_str  + dummy);
-                }
-            }
-            else
             {
-                if(idx >= x * y)
-                {
-                    throw std::runtime_error("pnm::read_pgm_ascii: file "  +
-                        fname + "contains too many pixels: "_str  +
-                        std::to_string(idx) + " pixels for "_str  +
-                        std::to_string(x)   + "x"_str             +
-                        std::to_string(y)   + " image"_str);
-                }
-                img.raw_access(idx++) = gray_pixel(gain->invoke(pix));
+                std::lock_guard<std::mutex> lock(mtx_);
+                jobs_.push_back(j);
             }
+            cv_.notify_all();
         }
+        run(*j);
+        this->remove(j);
+
+        std::unique_lock<std::mutex> lock(j->mtx);
+        j->cv.wait(lock, [&j]() noexcept {return j->done == j->n;});
+        return;
     }
-    return img;
-}
 
-template<typename Alloc = std::allocator<gray_pixel>>
-image<gray_pixel, Alloc> read_pgm_binary(const std::string& fname)
-{
-    using namespace detail::literals;
-    std::ifstream ifs(fname, std::ios::binary);
-    if(!ifs.good())
+  private:
+
+    struct job
     {
-        throw std::runtime_error(
-                "pnm::read_pgm_binary: file open error: " + fname);
-    }
+        job(const std::function<void(std::size_t)>& t, const std::size_t m)
+            : task(&t), n(m), next(0), done(0)
+        {}
+        const std::function<void(std::size_t)>* task;
+        const std::size_t        n;
+        std::atomic<std::size_t> next;
+        std::size_t              done; // guarded by mtx
+        std::mutex               mtx;
+        std::condition_variable  cv;
+    };
 
+    static void run(job& j) noexcept
     {
-        char desc[2] = {'\0', '\0'};
-        ifs.read(desc, 2);
-        if(!(desc[0] == 'P' && desc[1] == '5'))
+        std::size_t finished = 0;
+        for(std::size_t i = j.next++; i < j.n; i = j.next++)
+        {
+            (*j.task)(i);
+            ++finished;
+        }
+        if(finished != 0)
         {
-            throw std::runtime_error("pnm::read_pgm_binary: " + fname +
-                " is not a binary pgm file: magic number is "_str +
-                std::string{desc[0], desc[1]});
+            std::lock_guard<std::mutex> lock(j.mtx);
+            j.done += finished;
+            if(j.done == j.n) {j.cv.notify_all();}
         }
+        return;
     }
 
-    bool        x_read(false), y_read(false), max_read(false);
-    std::size_t x(0),          y(0),          max(0);
-    while(!ifs.eof())
+    // once all the tasks of a job are taken, the job is removed from the queue.
+    void remove(const std::shared_ptr<job>& j)
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
+        std::lock_guard<std::mutex> lock(mtx_);
+        const auto found = std::find(jobs_.begin(), jobs_.end(), j);
+        if(found != jobs_.end()) {jobs_.erase(found);}
+        return;
+    }
 
-        std::size_t tmp;
-        std::istringstream iss(line);
-        while(!iss.eof())
+    void work()
+    {
+        while(true)
         {
-            iss >> tmp;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_pgm_ascii: file " +
-                        fname + " contains invalid token: "_str  + dummy);
-                }
-            }
-            else
+            std::shared_ptr<job> j;
             {
-                if(  !x_read){  x = tmp;   x_read = true; continue;}
-                if(  !y_read){  y = tmp;   y_read = true; continue;}
-                if(!max_read){max = tmp; max_read = true; continue;}
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this]() noexcept {return stop_ || !jobs_.empty();});
+                if(jobs_.empty()) {return;} // stopped
+                j = jobs_.front();
             }
-        }
-        if(x_read && y_read && max_read)
-        {
-            break;
+            run(*j);
+            this->remove(j);
         }
     }
 
-    image<gray_pixel, Alloc> img(x, y);
-    const auto gain = detail::get_gain(max);
+  private:
+    bool                             stop_;
+    std::mutex                       mtx_;
+    std::condition_variable          cv_;
+    std::deque<std::shared_ptr<job>> jobs_;
+    std::vector<std::thread>         workers_;
+};
 
-    for(std::size_t i=0; i<img.size(); ++i)
-    {
-        std::uint8_t v(0);
-        ifs.read(reinterpret_cast<char*>(&v), 1);
-        img.raw_access(i) = gray_pixel(gain->invoke(v));
-    }
-    return img;
+// the thread pool that is used if no executor is specified. it is created
+// when it is used for the first time.
+inline executor& default_executor()
+{
+    static thread_pool pool;
+    return pool;
 }
 
-template<typename Alloc = std::allocator<gray_pixel>>
-image<gray_pixel, Alloc> read_pgm(const std::string& fname)
+// passed to read, write and convert_image to run them on multiple threads.
+// `threads` is the number of tasks a function is split into. `threads == 0`
+// means the concurrency of the executor. the tasks run on `exec`, or on
+// default_executor() if it is null.
+struct parallel_policy
 {
-    using namespace detail::literals;
-    char descripter[2];
+    constexpr explicit parallel_policy(const std::size_t n = 0) noexcept
+        : threads(n), exec(nullptr)
+    {}
+    constexpr parallel_policy(executor& e, const std::size_t n = 0) noexcept
+        : threads(n), exec(&e)
+    {}
+    std::size_t threads;
+    executor*   exec;
+};
+
+namespace detail
+{
+inline executor& executor_of(const parallel_policy& par) noexcept
+{
+    return (par.exec != nullptr) ? *par.exec : default_executor();
+}
+inline std::size_t thread_count(const parallel_policy& par) noexcept
+{
+    if(par.threads != 0) {return par.threads;}
+    return executor_of(par).concurrency();
+}
+
+// calls `func(i)` for i in [0, n) on the executor. the first exception thrown
+// by `func` is rethrown after all the tasks finish.
+template<typename F>
+void parallel_for(const parallel_policy& par, const std::size_t n, F&& func)
+{
+    std::vector<std::exception_ptr> errors(n);
+    executor_of(par).execute(n, [&func, &errors](const std::size_t i) noexcept {
+        try {func(i);} catch(...) {errors[i] = std::current_exception();}
+    });
+
+    for(const auto& error : errors)
     {
-        std::ifstream ifs(fname, std::ios::binary);
-        ifs.read(descripter, 2);
+        if(error) {std::rethrow_exception(error);}
     }
+    return;
+}
+} // detail
 
-    if(descripter[0] == 'P' && descripter[1] == '2')
+// --------------------------------------------------------------------------
+//    __                        _    * io functions and operators
+//   / _| ___  _ __ _ _ _  __ _| |_  * enum class format
+//  | |_ / _ \| '_/| ` ` \/ _` |  _| * operator<<(ostream, image)
+//  |  _| (_) | |  | | | | (_| | |_  * operator>>(ostream, image)
+//  |_|  \___/|_|  |_|_|_|\__,_|\__| * image read_*(filename)
+//                                   * void write_*(filenmae, image, format_flag = ascii)
+// --------------------------------------------------------------------------
+
+enum class format: bool {ascii, binary};
+
+// information written in the header of a pnm file.
+struct header
+{
+    char        magic;  // '1' to '7', or 'f' and 'F' for pfm
+    format      fmt;
+    std::size_t width;
+    std::size_t height;
+    std::size_t maxval; // 1 for pbm and pfm
+    std::size_t depth;  // the number of samples in a pixel
+    std::string tuple_type; // e.g. "GRAYSCALE", "RGB_ALPHA"
+    double      scale;  // pfm only. negative if little endian. 0 otherwise
+    std::size_t offset; // the position of the first byte of the payload
+};
+
+namespace detail
+{
+// convert pixel value range [0, max] -> [0, 255] (or [0, 65535] for 16-bit
+// pixels) by looking up a table that is built once per image. values larger
+// than max are clamped to max.
+template<typename T>
+class basic_gain_table
+{
+    static_assert(std::is_same<T, std::uint8_t >::value ||
+                  std::is_same<T, std::uint16_t>::value,
+                  "sample type should be 8-bit or 16-bit");
+  public:
+    basic_gain_table(): basic_gain_table(std::numeric_limits<T>::max()) {}
+
+    // the table covers all the values that a sample in a binary file can
+    // take, i.e. 1 byte if max < 256 and 2 bytes otherwise.
+    explicit basic_gain_table(const std::size_t max)
+        : max_(max), table_(max < 256 ? 256 : 65536)
     {
-        return read_pgm_ascii(fname);
+        for(std::size_t x=0; x<table_.size(); ++x)
+        {
+            table_[x] = rescale(std::min(x, max), max);
+        }
     }
-    else if(descripter[0] == 'P' && descripter[1] == '5')
+
+    bool is_identity() const noexcept
     {
-        return read_pgm_binary(fname);
+        return max_ == std::numeric_limits<T>::max();
     }
-    throw std::runtime_error("pnm::read_pgm: " + fname +
-        " is not a pgm file: magic number is "_str +
-        std::string{descripter[0], descripter[1]});
-}
 
-template<typename Alloc = std::allocator<rgb_pixel>>
-image<rgb_pixel, Alloc> read_ppm_ascii(const std::string& fname)
-{
-    using namespace detail::literals;
-    std::ifstream ifs(fname);
-    if(!ifs.good())
+    T operator()(const std::size_t x) const noexcept
     {
-        throw std::runtime_error(
-                "pnm::read_ppm_ascii: file open error: " + fname);
+        return table_[std::min(x, max_)];
     }
 
+    // converts samples read from a binary file. `src` may be equal to `dst`.
+    template<typename S>
+    void apply(const S* src, T* dst, const std::size_t n) const noexcept
     {
-        char desc[2] = {'\0', '\0'};
-        ifs.read(desc, 2);
-        if(!(desc[0] == 'P' && desc[1] == '3'))
+        const T* const table = table_.data();
+        for(std::size_t i=0; i<n; ++i)
         {
-            throw std::runtime_error("pnm::read_ppm_ascii: " + fname +
-                " is not a ppm file: magic number is "_str +
-                std::string{desc[0], desc[1]});
+            dst[i] = table[src[i]];
         }
+        return;
     }
 
-    bool        x_read(false), y_read(false), max_read(false);
-    std::size_t x(0),          y(0),          max(0);
-    while(!ifs.eof())
-    {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
+  private:
 
-        std::size_t tmp;
-        std::istringstream iss(line);
-        while(!iss.eof())
-        {
-            iss >> tmp;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_ppm_ascii: file " +
-                        fname + " contains invalid token: "_str + dummy);
-                }
-            }
-            else
-            {
-                if(  !x_read){  x = tmp;   x_read = true; continue;}
-                if(  !y_read){  y = tmp;   y_read = true; continue;}
-                if(!max_read){max = tmp; max_read = true; continue;}
-            }
-        }
-        if(x_read && y_read && max_read)
+    static T rescale(const std::size_t v, const std::size_t max) noexcept
+    {
+        if(std::is_same<T, std::uint16_t>::value)
         {
-            break;
+            return static_cast<T>((v * 65535 + max / 2) / max);
         }
+        if(max == 255) {return static_cast<T>(v);}
+        if(max <  255) {return static_cast<T>(v * (256 / (max + 1)));}
+        return static_cast<T>(v * (256.0 / (max + 1.0)));
     }
 
-    image<rgb_pixel, Alloc> img(x, y);
-    const auto gain = detail::get_gain(max);
-
-    bool R_read(false), G_read(false), B_read(false);
-    std::size_t idx=0;
-    rgb_pixel pixel;
+  private:
+    std::size_t    max_;
+    std::vector<T> table_;
+};
+using gain_table   = basic_gain_table<std::uint8_t>;
+using gain16_table = basic_gain_table<std::uint16_t>;
+
+// binary pixels are read directly into the storage of an image. it requires
+// that a pixel has exactly the same layout as the corresponding bytes in a file.
+static_assert(sizeof(bit_pixel)  == 1, "bit_pixel should be 1 byte");
+static_assert(sizeof(gray_pixel) == 1, "gray_pixel should be 1 byte");
+static_assert(sizeof(rgb_pixel)  == 3, "rgb_pixel should be packed 3 bytes");
+static_assert(std::is_standard_layout<rgb_pixel>::value,
+              "rgb_pixel should be a standard layout type");
+static_assert(sizeof(gray16_pixel) == 2, "gray16_pixel should be 2 bytes");
+static_assert(sizeof(rgb16_pixel)  == 6, "rgb16_pixel should be packed 6 bytes");
+static_assert(std::is_standard_layout<rgb16_pixel>::value,
+              "rgb16_pixel should be a standard layout type");
+static_assert(sizeof(gray_alpha_pixel)   == 2, "gray_alpha_pixel should be packed 2 bytes");
+static_assert(sizeof(rgba_pixel)         == 4, "rgba_pixel should be packed 4 bytes");
+static_assert(sizeof(gray_alpha16_pixel) == 4, "gray_alpha16_pixel should be packed 4 bytes");
+static_assert(sizeof(rgba16_pixel)       == 8, "rgba16_pixel should be packed 8 bytes");
+static_assert(sizeof(grayf_pixel)        == 4, "grayf_pixel should be 4 bytes");
+static_assert(sizeof(rgbf_pixel)         == 12, "rgbf_pixel should be packed 12 bytes");
+
+// binary payload is read and written in chunks that consist of whole lines
+// and are approximately this size.
+constexpr std::size_t binary_chunk_size = std::size_t(1) << 20;
+
+inline std::size_t lines_per_chunk(const std::size_t bytes_per_line) noexcept
+{
+    return (bytes_per_line == 0 || bytes_per_line >= binary_chunk_size) ? 1 :
+           binary_chunk_size / bytes_per_line;
+}
 
-    while(!ifs.eof())
+inline void read_payload(std::istream& is, char* dst, const std::size_t n,
+                         const char* func, const std::string& fname)
+{
+    is.read(dst, static_cast<std::streamsize>(n));
+    if(static_cast<std::size_t>(is.gcount()) != n)
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
-
-        std::size_t pix;
-        std::istringstream iss(line);
-        while(!iss.eof())
-        {
-            iss >> pix;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_ppm_ascii: file " +
-                        fname + " contains invalid token: "_str + dummy);
-                }
-            }
-            else
-            {
-                if(!R_read){pixel.red   = gain->invoke(pix); R_read = true; continue;}
-                if(!G_read){pixel.green = gain->invoke(pix); G_read = true; continue;}
-                if(!B_read){pixel.blue  = gain->invoke(pix); B_read = true;}
-                R_read = false;
-                G_read = false;
-                B_read = false;
-                if(idx >= x * y)
-                {
-                    throw std::runtime_error("pnm::read_ppm_ascii: file " +
-                        fname + "contains too many pixels: "_str +
-                        std::to_string(idx) + " pixels for "_str +
-                        std::to_string(x)   + "x"_str            +
-                        std::to_string(y)   + " image"_str);
-                }
-                img.raw_access(idx++) = pixel;
-            }
-        }
+        throw std::runtime_error(std::string(func) + ": file " + fname +
+            " is truncated: expected " + std::to_string(n) +
+            " bytes of pixels, but only " + std::to_string(is.gcount()) +
+            " bytes are found");
     }
-    return img;
+    return;
 }
 
-template<typename Alloc = std::allocator<rgb_pixel>>
-image<rgb_pixel, Alloc> read_ppm_binary(const std::string& fname)
+// converts 16-bit samples between big endian (in a file) and the native byte
+// order, in place.
+inline void swap_bytes16(std::uint16_t* samples, const std::size_t n) noexcept
 {
-    using namespace detail::literals;
-    std::ifstream ifs(fname, std::ios::binary);
-    if(!ifs.good())
+#ifdef PNM_BIG_ENDIAN
+    (void)samples; (void)n;
+#else
+    std::size_t i = 0;
+#  ifdef PNM_HAS_AVX2
+    const __m256i shuffle = _mm256_setr_epi8(
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for(; i + 16 <= n; i += 16)
     {
-        throw std::runtime_error(
-                "pnm::read_ppm_binary: file open error: " + fname);
+        __m256i* const p = reinterpret_cast<__m256i*>(samples + i);
+        _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), shuffle));
     }
-
+#  endif
+#  ifdef PNM_HAS_SSE2
+    for(; i + 8 <= n; i += 8)
     {
-        char desc[2] = {'\0', '\0'};
-        ifs.read(desc, 2);
-        if(!(desc[0] == 'P' && desc[1] == '6'))
-        {
-            throw std::runtime_error("pnm::read_ppm_binary: " + fname +
-                " is not a binary ppm file: magic number is "_str +
-                std::string{desc[0], desc[1]});
-        }
+        __m128i* const p = reinterpret_cast<__m128i*>(samples + i);
+        const __m128i v = _mm_loadu_si128(p);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#  endif
+    for(; i < n; ++i)
+    {
+        samples[i] = static_cast<std::uint16_t>((samples[i] << 8) | (samples[i] >> 8));
     }
+#endif
+    return;
+}
 
-    bool        x_read(false), y_read(false), max_read(false);
-    std::size_t x(0),          y(0),          max(0);
-    while(!ifs.eof())
+// reverses the byte order of `n` 4-byte words in place. pfm files may have
+// either byte order, so this is called only if it differs from the host.
+inline void reverse_bytes32(void* words, const std::size_t n) noexcept
+{
+    char* const bytes = static_cast<char*>(words);
+    std::size_t i = 0;
+#ifdef PNM_HAS_AVX2
+    const __m256i shuffle = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for(; i + 8 <= n; i += 8)
     {
-        std::string line;
-        std::getline(ifs, line);
-        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
-        if(line.empty()){continue;}
+        __m256i* const p = reinterpret_cast<__m256i*>(bytes + i * 4);
+        _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), shuffle));
+    }
+#endif
+#ifdef PNM_HAS_SSE2
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128i* const p = reinterpret_cast<__m128i*>(bytes + i * 4);
+        __m128i v = _mm_loadu_si128(p);
+        v = _mm_or_si128(_mm_slli_epi16(v,  8), _mm_srli_epi16(v,  8));
+        v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+        _mm_storeu_si128(p, v);
+    }
+#endif
+    for(; i < n; ++i)
+    {
+        std::reverse(bytes + i * 4, bytes + i * 4 + 4);
+    }
+    return;
+}
 
-        std::size_t tmp;
-        std::istringstream iss(line);
-        while(!iss.eof())
+// reads `n` samples into `dst` and rescales them by `gain`. a sample in a file
+// is 1 byte if maxval < 256, otherwise 2 bytes in big endian.
+template<typename T>
+void read_samples(std::istream& is, T* dst, const std::size_t n,
+                  const std::size_t maxval, const basic_gain_table<T>& gain,
+                  const char* func, const std::string& fname)
+{
+    const std::size_t bytes_per_sample = (maxval < 256) ? 1 : 2;
+    if(bytes_per_sample == sizeof(T))
+    {
+        // samples can be read directly into `dst`
+        const std::size_t chunk = binary_chunk_size / sizeof(T);
+        for(std::size_t i=0; i<n; i+=chunk)
         {
-            iss >> tmp;
-            if(iss.fail())
-            {
-                std::string dummy;
-                iss >> dummy;
-                if(!std::all_of(dummy.begin(), dummy.end(), [](const char c){
-                        return std::isspace(static_cast<int>(c));
-                    }))
-                {
-                    throw std::runtime_error("pnm::read_ppm_ascii: file " +
-                        fname + " contains invalid token: "_str + dummy);
-                }
-            }
-            else
+            const std::size_t m = std::min(chunk, n - i);
+            read_payload(is, reinterpret_cast<char*>(dst + i), m * sizeof(T),
+                         func, fname);
+            if(sizeof(T) == 2)
             {
-                if(  !x_read){  x = tmp;   x_read = true; continue;}
-                if(  !y_read){  y = tmp;   y_read = true; continue;}
-                if(!max_read){max = tmp; max_read = true; continue;}
+                swap_bytes16(reinterpret_cast<std::uint16_t*>(dst + i), m);
             }
+            if(!gain.is_identity()) {gain.apply(dst + i, dst + i, m);}
         }
-        if(x_read && y_read && max_read)
+        return;
+    }
+
+    const std::size_t chunk = binary_chunk_size / bytes_per_sample;
+    if(bytes_per_sample == 1)
+    {
+        std::vector<std::uint8_t> buf(std::min(chunk, n));
+        for(std::size_t i=0; i<n; i+=chunk)
         {
-            break;
+            const std::size_t m = std::min(chunk, n - i);
+            read_payload(is, reinterpret_cast<char*>(buf.data()), m, func, fname);
+            gain.apply(buf.data(), dst + i, m);
         }
     }
-
-    image<rgb_pixel, Alloc> img(x, y);
-    const auto gain = detail::get_gain(max);
-
-    for(std::size_t i=0; i<img.size(); ++i)
+    else
     {
-        std::uint8_t R(0), G(0), B(0);
-        ifs.read(reinterpret_cast<char*>(&R), 1);
-        ifs.read(reinterpret_cast<char*>(&G), 1);
-        ifs.read(reinterpret_cast<char*>(&B), 1);
-        img.raw_access(i) =
-            rgb_pixel(gain->invoke(R), gain->invoke(G), gain->invoke(B));
+        std::vector<std::uint16_t> buf(std::min(chunk, n));
+        for(std::size_t i=0; i<n; i+=chunk)
+        {
+            const std::size_t m = std::min(chunk, n - i);
+            read_payload(is, reinterpret_cast<char*>(buf.data()), m * 2,
+                         func, fname);
+            swap_bytes16(buf.data(), m);
+            gain.apply(buf.data(), dst + i, m);
+        }
     }
-    return img;
+    return;
 }
 
-template<typename Alloc = std::allocator<rgb_pixel>>
-image<rgb_pixel, Alloc> read_ppm(const std::string& fname)
+// expand one line of P4 payload. the MSB of the first byte is the first pixel.
+// whole bytes are expanded by SIMD kernels or 8 bytes at a time via uint64_t.
+inline void unpack_bits(const std::uint8_t* src, bit_pixel* dst,
+                        const std::size_t width) noexcept
 {
-    using namespace detail::literals;
-    char descripter[2];
+    static_assert(sizeof(bit_pixel) == 1, "bit_pixel should be 1 byte");
+    const std::size_t quot = width >> 3u;
+    const std::size_t rem  = width &  7u;
+    char* const out = reinterpret_cast<char*>(dst);
+    std::size_t i = 0;
+#ifdef PNM_HAS_AVX2
     {
-        std::ifstream ifs(fname, std::ios::binary);
-        ifs.read(descripter, 2);
+        // broadcast 4 bytes and spread each of them into 8 bytes.
+        const __m256i spread = _mm256_setr_epi8(
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+        const __m256i mask = _mm256_setr_epi8(
+                -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+                -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+        const __m256i one = _mm256_set1_epi8(1);
+        for(; i + 4 <= quot; i += 4)
+        {
+            std::int32_t word;
+            std::memcpy(&word, src + i, 4);
+            const __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+            const __m256i r = _mm256_and_si256(one,
+                    _mm256_cmpeq_epi8(_mm256_and_si256(v, mask), mask));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 8), r);
+        }
     }
-
-    if(descripter[0] == 'P' && descripter[1] == '3')
+#endif
+#ifdef PNM_HAS_SSE2
+    {
+        // duplicate each byte 8 times by unpacking it with itself 3 times.
+        const __m128i mask = _mm_setr_epi8(
+                -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+        const __m128i one = _mm_set1_epi8(1);
+        const auto expand = [&mask, &one](const __m128i v, char* p) noexcept {
+            const __m128i r = _mm_and_si128(one,
+                    _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), r);
+        };
+        for(; i + 16 <= quot; i += 16)
+        {
+            const __m128i x  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i a0 = _mm_unpacklo_epi8(x, x);
+            const __m128i a1 = _mm_unpackhi_epi8(x, x);
+            const __m128i b0 = _mm_unpacklo_epi16(a0, a0);
+            const __m128i b1 = _mm_unpackhi_epi16(a0, a0);
+            const __m128i b2 = _mm_unpacklo_epi16(a1, a1);
+            const __m128i b3 = _mm_unpackhi_epi16(a1, a1);
+            char* const p = out + i * 8;
+            expand(_mm_unpacklo_epi32(b0, b0), p);
+            expand(_mm_unpackhi_epi32(b0, b0), p +  16);
+            expand(_mm_unpacklo_epi32(b1, b1), p +  32);
+            expand(_mm_unpackhi_epi32(b1, b1), p +  48);
+            expand(_mm_unpacklo_epi32(b2, b2), p +  64);
+            expand(_mm_unpackhi_epi32(b2, b2), p +  80);
+            expand(_mm_unpacklo_epi32(b3, b3), p +  96);
+            expand(_mm_unpackhi_epi32(b3, b3), p + 112);
+        }
+    }
+#endif
+    // copy a byte to all the 8 bytes, keep one bit per byte, and make it 0/1.
+#ifdef PNM_BIG_ENDIAN
+    const std::uint64_t mask = 0x8040201008040201ull;
+#else
+    const std::uint64_t mask = 0x0102040810204080ull;
+#endif
+    for(; i < quot; ++i)
     {
-        return read_ppm_ascii(fname);
+        std::uint64_t x = (src[i] * 0x0101010101010101ull) & mask;
+        x = ((x + 0x7F7F7F7F7F7F7F7Full) >> 7u) & 0x0101010101010101ull;
+        std::memcpy(out + i * 8, &x, 8);
     }
-    else if(descripter[0] == 'P' && descripter[1] == '6')
+    for(std::size_t r=0; r<rem; ++r)
     {
-        return read_ppm_binary(fname);
+        const std::size_t bit = (1 << (7-r));
+        dst[quot*8 + r] = bit_pixel((src[quot] & bit) == bit);
     }
-    throw std::runtime_error("pnm::read_ppm: " + fname +
-            " is not a ppm file: magic number is "_str +
-            std::string{descripter[0], descripter[1]});
+    return;
 }
 
-namespace detail
-{
-template<typename Pixel, typename Alloc, typename FromPixel, typename FromAlloc>
-struct convert_image_impl
+// pack one line of pixels into P4 payload. the first pixel becomes the MSB.
+// whole bytes are packed by SIMD kernels or 8 pixels at a time via uint64_t.
+inline void pack_bits(const bit_pixel* src, std::uint8_t* dst,
+                      const std::size_t width) noexcept
 {
-    static image<Pixel, Alloc> invoke(const image<FromPixel, FromAlloc>& img)
+    const std::size_t quot = width >> 3u;
+    const std::size_t rem  = width &  7u;
+    const char* const in = reinterpret_cast<const char*>(src);
+    std::size_t i = 0;
+#ifdef PNM_HAS_AVX2
     {
-        image<Pixel, Alloc> retval(img.x_size(), img.y_size());
-        for(std::size_t i=0; i<img.size(); ++i)
+        // reverse pixels in each 8 bytes so that movemask puts the first
+        // pixel at the MSB.
+        const __m256i reverse = _mm256_setr_epi8(
+                7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        const __m256i zero = _mm256_setzero_si256();
+        for(; i + 4 <= quot; i += 4)
         {
-            retval.raw_access(i) =
-                convert_impl<FromPixel, Pixel>::invoke(img.raw_access(i));
+            const __m256i v = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(in + i * 8));
+            const std::uint32_t m = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(
+                    _mm256_shuffle_epi8(_mm256_cmpeq_epi8(v, zero), reverse)));
+            dst[i+0] = static_cast<std::uint8_t>(m       );
+            dst[i+1] = static_cast<std::uint8_t>(m >>  8u);
+            dst[i+2] = static_cast<std::uint8_t>(m >> 16u);
+            dst[i+3] = static_cast<std::uint8_t>(m >> 24u);
         }
-        return retval;
     }
-};
-// if `from` and `to` has the same type, no conversion is needed.
-template<typename Pixel, typename Alloc>
-struct convert_image_impl<Pixel, Alloc, Pixel, Alloc>
-{
-    static inline image<Pixel, Alloc>
-    invoke(const image<Pixel, Alloc>& img) noexcept {return img;}
-};
-}// detail
-
-template<typename Pixel, typename Alloc, typename FromPixel, typename FromAlloc>
-image<Pixel, Alloc> convert_image(const image<FromPixel, FromAlloc>& img)
-{
-    return detail::convert_image_impl<Pixel, Alloc, FromPixel, FromAlloc
-        >::invoke(img);
-}
-template<typename Pixel, typename Alloc, typename FromPixel, typename FromAlloc>
-image<Pixel, Alloc> convert_image(image<FromPixel, FromAlloc>&& img)
-{
-    return detail::convert_image_impl<Pixel, Alloc, FromPixel, FromAlloc
-        >::invoke(std::move(img));
-}
-
-template<typename Pixel = rgb_pixel, typename Alloc = std::allocator<Pixel>>
-image<Pixel, Alloc> read(const std::string& fname)
-{
-    using namespace detail::literals;
-    char descripter[2];
+#endif
+#ifdef PNM_HAS_SSE2
     {
-        std::ifstream ifs(fname, std::ios::binary);
-        ifs.read(descripter, 2);
+        const __m128i zero = _mm_setzero_si128();
+        for(; i + 2 <= quot; i += 2)
+        {
+            const __m128i v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(in + i * 8));
+            __m128i z = _mm_cmpeq_epi8(v, zero);
+            z = _mm_shufflelo_epi16(z, _MM_SHUFFLE(0, 1, 2, 3));
+            z = _mm_shufflehi_epi16(z, _MM_SHUFFLE(0, 1, 2, 3));
+            z = _mm_or_si128(_mm_slli_epi16(z, 8), _mm_srli_epi16(z, 8));
+            const std::uint32_t m = ~static_cast<std::uint32_t>(_mm_movemask_epi8(z));
+            dst[i+0] = static_cast<std::uint8_t>(m      );
+            dst[i+1] = static_cast<std::uint8_t>(m >> 8u);
+        }
     }
-    if(descripter[0] != 'P')
+#endif
+    // gathers the lowest bit of each byte into the top byte. the first pixel
+    // goes to the MSB.
+#ifdef PNM_BIG_ENDIAN
+    const std::uint64_t magic = 0x0102040810204080ull;
+#else
+    const std::uint64_t magic = 0x8040201008040201ull;
+#endif
+    for(; i < quot; ++i)
     {
-        throw std::runtime_error("pnm::read: " + fname +
-                " is not any of pnm format: magic number is "_str +
-                std::string{descripter[0], descripter[1]});
+        std::uint64_t x;
+        std::memcpy(&x, in + i * 8, 8);
+        dst[i] = static_cast<std::uint8_t>((x * magic) >> 56u);
     }
-
-    switch(descripter[1])
+    if(rem != 0)
     {
-        case '1': {return convert_image<Pixel, Alloc>(read_pbm_ascii (fname));}
-        case '2': {return convert_image<Pixel, Alloc>(read_pgm_ascii (fname));}
-        case '3': {return convert_image<Pixel, Alloc>(read_ppm_ascii (fname));}
-        case '4': {return convert_image<Pixel, Alloc>(read_pbm_binary(fname));}
-        case '5': {return convert_image<Pixel, Alloc>(read_pgm_binary(fname));}
-        case '6': {return convert_image<Pixel, Alloc>(read_ppm_binary(fname));}
-        default:
+        std::uint8_t v(0u);
+        for(std::size_t r=0; r<rem; ++r)
         {
-            throw std::runtime_error("pnm::read: " + fname +
-                " is not any of pnm format: magic number is "_str +
-                std::string{descripter[0], descripter[1]});
+            if(src[quot*8 + r].value) {v |= static_cast<std::uint8_t>(1u << (7-r));}
         }
+        dst[quot] = v;
     }
+    return;
 }
 
-// --------------------------------------------------------------------------
-//                  _ _          * write_(pbm|pgm|ppm)_(ascii|binary)
-//  __      __ _ __(_) |_  ___     - the most specific ones
-//  \ \ /\ / /| '_/| | __|/ _ \  * write_(pbm|pgm|ppm)
-//   \ v  v / | |  | | |_(  __/    - requires format specifier
-//    \_/\_/  |_|  |_|\__|\___|  * write()
-//                                 - format is determined by pixel type
-// --------------------------------------------------------------------------
+namespace literals
+{
+inline std::string operator"" _str(const char* s, std::size_t len)
+{
+    return std::string(s, len);
+}
+} // literals
 
-template<typename Alloc>
-void write_pbm_ascii(const std::string& fname,
-                     const image<bit_pixel, Alloc>& img)
+// ' ', '\t', '\n', '\v', '\f', '\r'. unlike std::isspace, it does not
+// depend on the locale.
+inline bool is_space(const char c) noexcept
 {
-    std::ofstream ofs(fname);
-    if(!ofs.good())
+    return c == ' ' || static_cast<unsigned char>(c - '\t') < 5;
+}
+
+// splits ascii payload into unsigned integers, skipping whitespaces and
+// comments that start with '#'. it reads the stream in large blocks and parses
+// numbers without locale, so it is much faster than istream::operator>>.
+class ascii_tokenizer
+{
+  public:
+    ascii_tokenizer(std::istream& is, const char* func, const std::string& fname)
+        : is_(is), pos_(0), end_(0), in_comment_(false), buf_(block_size),
+          func_(func), fname_(fname)
+    {}
+
+    // returns false if it reaches the end of file.
+    bool next(std::size_t& value)
     {
-        throw std::runtime_error(
-                "pnm::write_pbm_ascii: file open error: " + fname);
+        // skip whitespaces and comments. a comment may continue in the next block.
+        while(true)
+        {
+            const char* const first = buf_.data();
+            const char* p = first + pos_;
+            const char* const last = first + end_;
+            if(in_comment_)
+            {
+                const char* const nl = static_cast<const char*>(
+                    std::memchr(p, '\n', static_cast<std::size_t>(last - p)));
+                if(nl == nullptr)
+                {
+                    if(!this->fill()) {return false;}
+                    continue;
+                }
+                p = nl + 1;
+                in_comment_ = false;
+            }
+            while(p != last && is_space(*p)) {++p;}
+            pos_ = static_cast<std::size_t>(p - first);
+
+            if(p == last)
+            {
+                if(!this->fill()) {return false;}
+                continue;
+            }
+            if(*p != '#') {break;}
+
+            pos_ += 1;
+            in_comment_ = true;
+        }
+
+        // fast path: the token ends in the current block and cannot overflow.
+        const char* const first = buf_.data() + pos_;
+        const char* const last  = buf_.data() + end_;
+        const char* p = first;
+        std::size_t v = 0;
+        while(p != last && static_cast<unsigned char>(*p - '0') < 10)
+        {
+            v = v * 10 + static_cast<std::size_t>(*p - '0');
+            ++p;
+        }
+        if(p != last && (is_space(*p) || *p == '#') && p - first < 19)
+        {
+            pos_ += static_cast<std::size_t>(p - first);
+            value = v;
+            return true;
+        }
+        return this->next_slow(value);
     }
 
-    ofs << "P1\n" << img.x_size() << ' ' << img.y_size() << "\n";
+  private:
 
-    for(std::size_t j=0; j<img.y_size(); ++j)
+    // handles a token that lies across blocks, overflows, or is invalid.
+    bool next_slow(std::size_t& value)
     {
-        for(std::size_t i=0; i<img.x_size(); ++i)
+        std::size_t v = 0;
+        std::size_t first = pos_;
+        std::string carry; // a part of the token in the previous block
+        while(true)
         {
-            ofs << (img(i, j).value ? '1' : '0');
-            if(i+1 != img.x_size()){ofs << ' ';}
+            if(pos_ == end_)
+            {
+                carry.append(buf_.data() + first, buf_.data() + pos_);
+                if(!this->fill()) {break;}
+                first = 0;
+                continue;
+            }
+            const char c = buf_[pos_];
+            if('0' <= c && c <= '9')
+            {
+                const std::size_t d = static_cast<std::size_t>(c - '0');
+                v = (v <= (max_value - d) / 10) ? v * 10 + d : max_value;
+                ++pos_;
+                continue;
+            }
+            if(is_space(c) || c == '#') {break;}
+
+            // invalid token. collect the rest of it for the error message.
+            while(true)
+            {
+                if(pos_ == end_)
+                {
+                    carry.append(buf_.data() + first, buf_.data() + pos_);
+                    first = 0;
+                    if(!this->fill()) {break;}
+                    continue;
+                }
+                const char ch = buf_[pos_];
+                if(is_space(ch) || ch == '#') {break;}
+                ++pos_;
+            }
+            carry.append(buf_.data() + first, buf_.data() + pos_);
+            throw std::runtime_error(std::string(func_) + ": file " + fname_ +
+                    " contains invalid token: " + carry);
         }
-        ofs << '\n';
+        value = v;
+        return true;
     }
-    return ;
-}
 
-template<typename Alloc>
-void write_pbm_binary(const std::string& fname,
-                      const image<bit_pixel, Alloc>& img)
-{
-    std::ofstream ofs(fname, std::ios::binary);
-    if(!ofs.good())
+    bool fill()
     {
-        throw std::runtime_error(
-                "pnm::write_pbm_binary: file open error: " + fname);
+        is_.read(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+        this->pos_ = 0;
+        this->end_ = static_cast<std::size_t>(is_.gcount());
+        return end_ != 0;
     }
 
-    ofs << "P4\n" << img.x_size() << ' ' << img.y_size() << "\n";
-
-    const auto get_or = [](const std::size_t i, const std::size_t j,
-                           const image<bit_pixel, Alloc>& im) -> bool {
-        if(i < im.x_size() && j < im.y_size()) {return im(i, j).value;}
-        return false;
-    };
+  private:
+    static constexpr std::size_t block_size = std::size_t(1) << 16;
+    static constexpr std::size_t max_value  = ~std::size_t(0);
+
+    std::istream&      is_;
+    std::size_t        pos_, end_;
+    bool               in_comment_;
+    std::vector<char>  buf_;
+    const char*        func_;
+    std::string        fname_;
+};
 
-    for(std::size_t j=0; j<img.y_size(); ++j)
+// a read-only streambuf over a memory region. the region is not copied.
+class memory_streambuf : public std::streambuf
+{
+  public:
+    memory_streambuf(const void* data, const std::size_t size) noexcept
     {
-        for(std::size_t i=0; i<img.x_size(); i+=8)
-        {
-            std::uint8_t buf(0u);
-            if(get_or(i+0, j, img)){buf |= 0x80;}
-            if(get_or(i+1, j, img)){buf |= 0x40;}
-            if(get_or(i+2, j, img)){buf |= 0x20;}
-            if(get_or(i+3, j, img)){buf |= 0x10;}
-            if(get_or(i+4, j, img)){buf |= 0x08;}
-            if(get_or(i+5, j, img)){buf |= 0x04;}
-            if(get_or(i+6, j, img)){buf |= 0x02;}
-            if(get_or(i+7, j, img)){buf |= 0x01;}
-            ofs.write(reinterpret_cast<const char*>(&buf), 1);
-        }
+        char* const first = const_cast<char*>(static_cast<const char*>(data));
+        this->setg(first, first, first + size);
     }
-    return ;
-}
+};
 
-template<typename Alloc>
-void write_pbm(const std::string& fname, const image<bit_pixel, Alloc>& img,
-               const format fmt)
+inline std::size_t parse_header_value(const std::string& token,
+        const char* func, const std::string& fname)
 {
-    if(fmt == format::ascii)
+    if(token.empty() || token.size() > 19 ||
+       !std::all_of(token.begin(), token.end(),
+                    [](const char ch){return '0' <= ch && ch <= '9';}))
     {
-        return write_pbm_ascii(fname, img);
+        throw std::runtime_error(std::string(func) + ": file " + fname +
+                " contains invalid token: " + token);
     }
-    else if(fmt == format::binary)
+    std::size_t v = 0;
+    for(const char ch : token)
     {
-        return write_pbm_binary(fname, img);
+        v = v * 10 + static_cast<std::size_t>(ch - '0');
     }
-    throw std::runtime_error("pnm::write_pbm: "
-            "invalid format flag (neither ascii nor binary)");
+    return v;
 }
 
-template<typename Alloc>
-void write_pgm_ascii(const std::string& fname,
-                     const image<gray_pixel, Alloc>& img)
+// the scale of pfm is a non-zero real number. its sign tells the byte order.
+inline double parse_header_scale(const std::string& token,
+        const char* func, const std::string& fname)
 {
-    std::ofstream ofs(fname);
-    if(!ofs.good())
+    std::istringstream iss(token);
+    iss.imbue(std::locale::classic());
+    double v = 0.0;
+    iss >> v;
+    if(token.empty() || iss.fail() || !iss.eof() || v == 0.0 || !std::isfinite(v))
     {
-        throw std::runtime_error(
-                "pnm::write_pgm_ascii: file open error: " + fname);
+        throw std::runtime_error(std::string(func) + ": file " + fname +
+                " contains invalid token: " + token);
     }
+    return v;
+}
 
-    ofs << "P2\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
+// reads the lines of a pam header after "P7" until "ENDHDR".
+inline void read_pam_header(std::istream& is, header& hdr,
+        const char* func, const std::string& fname)
+{
+    bool found[4] = {false, false, false, false};
+    std::size_t* const values[4] = {&hdr.width, &hdr.height, &hdr.depth, &hdr.maxval};
+    const char* const keys[4] = {"WIDTH", "HEIGHT", "DEPTH", "MAXVAL"};
 
-    for(std::size_t j=0; j<img.y_size(); ++j)
+    while(true)
     {
-        for(std::size_t i=0; i<img.x_size(); ++i)
+        std::string line;
+        int c = is.get();
+        while(c != std::char_traits<char>::eof() && c != '\n')
+        {
+            line += static_cast<char>(c);
+            c = is.get();
+        }
+        if(c == std::char_traits<char>::eof())
+        {
+            throw std::runtime_error(std::string(func) + ": file " + fname +
+                    " has an incomplete header");
+        }
+        hdr.offset += line.size() + 1;
+
+        const auto first = std::find_if(line.begin(), line.end(),
+                [](const char ch) {return !is_space(ch);});
+        if(first == line.end() || *first == '#') {continue;}
+        const auto key_last = std::find_if(first, line.end(), is_space);
+        const std::string key(first, key_last);
+        const auto value_first = std::find_if(key_last, line.end(),
+                [](const char ch) {return !is_space(ch);});
+        auto value_last = line.end();
+        while(value_last != value_first && is_space(*(value_last - 1))) {--value_last;}
+        const std::string value(value_first, value_last);
+
+        if(key == "ENDHDR") {break;}
+        if(key == "TUPLTYPE")
+        {
+            if(!hdr.tuple_type.empty()) {hdr.tuple_type += ' ';}
+            hdr.tuple_type += value;
+            continue;
+        }
+        const auto k = std::find_if(keys, keys + 4, [&key](const char* name) {
+                return key == name;
+            }) - keys;
+        if(k == 4)
         {
-            ofs << std::setw(3) << static_cast<int>(img(i, j).value);
-            if(i+1 != img.x_size()){ofs << ' ';}
+            throw std::runtime_error(std::string(func) + ": file " + fname +
+                    " contains unknown header field: " + key);
         }
-        ofs << '\n';
+        *values[k] = parse_header_value(value, func, fname);
+        found[k] = true;
     }
-    return ;
+    if(!std::all_of(found, found + 4, [](const bool b) {return b;}))
+    {
+        throw std::runtime_error(std::string(func) + ": file " + fname +
+                " has an incomplete header");
+    }
+    if(hdr.depth == 0)
+    {
+        throw std::runtime_error(std::string(func) + ": file " + fname +
+                " has an invalid depth: 0");
+    }
+    return;
 }
 
-template<typename Alloc>
-void write_pgm_binary(const std::string& fname,
-                      const image<gray_pixel, Alloc>& img)
+// reads the magic number and the following values (width, height, and
+// maxval or scale if any). after this, `is` points the first byte of the payload.
+// as the spec says, exactly one whitespace after the last integer is skipped.
+inline header read_header(std::istream& is, const char* func,
+                          const std::string& fname)
 {
-    std::ofstream ofs(fname, std::ios::binary);
-    if(!ofs.good())
+    using namespace detail::literals;
+    char desc[2] = {'\0', '\0'};
+    is.read(desc, 2);
+    const bool is_pfm = (desc[1] == 'f' || desc[1] == 'F');
+    if(desc[0] != 'P' || ((desc[1] < '1' || '7' < desc[1]) && !is_pfm))
     {
-        throw std::runtime_error(
-                "pnm::write_pgm_ascii: file open error: " + fname);
+        throw std::runtime_error(std::string(func) + ": " + fname +
+            " is not any of pnm format: magic number is "_str +
+            std::string{desc[0], desc[1]});
     }
 
-    ofs << "P5\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
-
-    for(std::size_t j=0; j<img.y_size(); ++j)
+    header hdr;
+    hdr.magic  = desc[1];
+    hdr.fmt    = (desc[1] < '4') ? format::ascii : format::binary;
+    hdr.width  = 0;
+    hdr.height = 0;
+    hdr.maxval = 1;
+    hdr.scale  = 0.0;
+    hdr.offset = 2;
+
+    const bool is_pbm = (desc[1] == '1' || desc[1] == '4');
+    const bool is_ppm = (desc[1] == '3' || desc[1] == '6' || desc[1] == 'F');
+    hdr.depth      = is_ppm ? 3 : 1;
+    hdr.tuple_type = is_pbm ? "BLACKANDWHITE" : is_ppm ? "RGB" : "GRAYSCALE";
+
+    if(desc[1] == '7')
     {
-        for(std::size_t i=0; i<img.x_size(); ++i)
+        hdr.tuple_type.clear();
+        read_pam_header(is, hdr, func, fname);
+        if(hdr.maxval == 0 || 65535 < hdr.maxval)
         {
-            ofs.write(reinterpret_cast<const char*>(
-                        std::addressof(img(i, j).value)), 1);
+            throw std::runtime_error(std::string(func) + ": file " + fname +
+                    " has an invalid maxval: " + std::to_string(hdr.maxval));
         }
+        return hdr;
     }
-    return ;
-}
 
-template<typename Alloc>
-void write_pgm(const std::string& fname, const image<gray_pixel, Alloc>& img,
-               const format fmt)
-{
-    if(fmt == format::ascii)
+    std::size_t* const values[3] = {&hdr.width, &hdr.height, &hdr.maxval};
+    const std::size_t n = is_pbm ? 2 : 3;
+
+    const auto skip_comment = [&is, &hdr]() {
+        int c = is.get();
+        while(c != std::char_traits<char>::eof() && c != '\n')
+        {
+            hdr.offset += 1;
+            c = is.get();
+        }
+        if(c == '\n') {hdr.offset += 1;}
+    };
+
+    for(std::size_t k=0; k<n; ++k)
     {
-        return write_pgm_ascii(fname, img);
+        // skip whitespaces and comments
+        int c = is.peek();
+        while(c != std::char_traits<char>::eof())
+        {
+            if(c == '#')
+            {
+                skip_comment();
+            }
+            else if(is_space(static_cast<char>(c)))
+            {
+                is.get();
+                hdr.offset += 1;
+            }
+            else
+            {
+                break;
+            }
+            c = is.peek();
+        }
+        if(c == std::char_traits<char>::eof())
+        {
+            throw std::runtime_error(std::string(func) + ": file " + fname +
+                    " has an incomplete header");
+        }
+
+        std::string token;
+        while(c != std::char_traits<char>::eof() && c != '#' &&
+              !is_space(static_cast<char>(c)))
+        {
+            token += static_cast<char>(is.get());
+            hdr.offset += 1;
+            c = is.peek();
+        }
+        if(is_pfm && k == 2)
+        {
+            hdr.scale = parse_header_scale(token, func, fname);
+        }
+        else
+        {
+            *values[k] = parse_header_value(token, func, fname);
+        }
     }
-    else if(fmt == format::binary)
+
+    if(!is_pbm && (hdr.maxval == 0 || 65535 < hdr.maxval))
     {
-        return write_pgm_binary(fname, img);
+        throw std::runtime_error(std::string(func) + ": file " + fname +
+                " has an invalid maxval: " + std::to_string(hdr.maxval));
     }
-    throw std::runtime_error("pnm::write_pgm: "
-            "invalid format flag (neither ascii nor binary)");
+
+    // the last integer is followed by exactly one whitespace.
+    const int c = is.peek();
+    if(c == '#')
+    {
+        skip_comment();
+    }
+    else if(c != std::char_traits<char>::eof())
+    {
+        is.get();
+        hdr.offset += 1;
+    }
+    is.clear(is.rdstate() & ~std::ios::eofbit);
+    return hdr;
 }
+} // detail
 
+// --------------------------------------------------------------------------
+//                  _           _  * pnm::packed_bit_image
+//  _ __  __ _  ___| | __ ___ _| |   - stores bit_pixels as bits
+// | '_ \/ _` |/ __| |/ // _ \ _` |  - rows are padded to bytes, as P4
+// | |_) )(_| | (__|   <(  __/(_| |  * packed_bit_image::reference
+// | .__/\__,_|\___|_|\_\\___|\__,_|   - proxy to a bit
+// |_|
+// --------------------------------------------------------------------------
 
-template<typename Alloc>
-void write_ppm_ascii(const std::string& fname,
-                     const image<rgb_pixel, Alloc>& img)
+template<typename Alloc = std::allocator<std::uint8_t>>
+class packed_bit_image
 {
-    std::ofstream ofs(fname);
-    if(!ofs.good())
+  public:
+    using pixel_type      = bit_pixel;
+    using allocator_type  = Alloc;
+    using container_type  = std::vector<std::uint8_t, allocator_type>;
+    using const_reference = bit_pixel;
+
+    // refers a bit in the storage, like std::vector<bool>::reference.
+    class reference
     {
-        throw std::runtime_error(
-                "pnm::write_ppm_ascii: file open error: " + fname);
+      public:
+        reference(std::uint8_t& byte, const std::uint8_t mask) noexcept
+            : byte_(std::addressof(byte)), mask_(mask)
+        {}
+        reference(const reference&) = default;
+
+        reference& operator=(const bit_pixel& pixel) noexcept
+        {
+            if(pixel.value) {*byte_ = static_cast<std::uint8_t>(*byte_ |  mask_);}
+            else            {*byte_ = static_cast<std::uint8_t>(*byte_ & ~mask_);}
+            return *this;
+        }
+        reference& operator=(const reference& other) noexcept
+        {
+            return *this = static_cast<bit_pixel>(other);
+        }
+
+        operator bit_pixel() const noexcept {return bit_pixel((*byte_ & mask_) != 0);}
+
+        friend bool operator==(const reference& lhs, const bit_pixel& rhs) noexcept
+        {return static_cast<bit_pixel>(lhs) == rhs;}
+        friend bool operator==(const bit_pixel& lhs, const reference& rhs) noexcept
+        {return lhs == static_cast<bit_pixel>(rhs);}
+        friend bool operator!=(const reference& lhs, const bit_pixel& rhs) noexcept
+        {return !(lhs == rhs);}
+        friend bool operator!=(const bit_pixel& lhs, const reference& rhs) noexcept
+        {return !(lhs == rhs);}
+
+      private:
+        std::uint8_t* byte_;
+        std::uint8_t  mask_;
+    };
+
+    packed_bit_image(): nx_(0), ny_(0), bytes_per_line_(0) {}
+    ~packed_bit_image() = default;
+    packed_bit_image(const packed_bit_image&) = default;
+    packed_bit_image(packed_bit_image&&)      = default;
+    packed_bit_image& operator=(const packed_bit_image&) = default;
+    packed_bit_image& operator=(packed_bit_image&&)      = default;
+
+    packed_bit_image(const std::size_t width, const std::size_t height)
+        : nx_(width), ny_(height), bytes_per_line_((width + 7) / 8),
+          bits_(bytes_per_line_ * height, 0u)
+    {}
+    packed_bit_image(const std::size_t width, const std::size_t height,
+                     const bit_pixel& pix)
+        : nx_(width), ny_(height), bytes_per_line_((width + 7) / 8),
+          bits_(bytes_per_line_ * height, pix.value ? 0xFFu : 0u)
+    {
+        this->clear_padding();
     }
 
-    ofs << "P3\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
+    explicit packed_bit_image(const const_image_view<bit_pixel>& view)
+        : packed_bit_image(view.width(), view.height())
+    {
+        for(std::size_t j=0; j<ny_; ++j)
+        {
+            detail::pack_bits(view.row_ptr(j), this->row_data(j), nx_);
+        }
+    }
+    template<typename PixelAlloc>
+    explicit packed_bit_image(const image<bit_pixel, PixelAlloc>& img)
+        : packed_bit_image(const_image_view<bit_pixel>(img))
+    {}
 
-    for(std::size_t j=0; j<img.y_size(); ++j)
+    // expands bits into an image that has one bit_pixel per byte.
+    template<typename PixelAlloc = std::allocator<bit_pixel>>
+    image<bit_pixel, PixelAlloc> unpack() const
     {
-        for(std::size_t i=0; i<img.x_size(); ++i)
+        image<bit_pixel, PixelAlloc> img(nx_, ny_);
+        for(std::size_t j=0; j<ny_ && nx_ != 0; ++j)
         {
-            const auto& pixel = img(i, j);
-            ofs << std::setw(3) << static_cast<int>(pixel.red)   << ' '
-                << std::setw(3) << static_cast<int>(pixel.green) << ' '
-                << std::setw(3) << static_cast<int>(pixel.blue);
-            if(i+1 != img.x_size()){ofs << ' ';}
+            detail::unpack_bits(this->row_data(j), std::addressof(img(0, j)), nx_);
         }
-        ofs << '\n';
+        return img;
     }
-    return ;
+
+    reference operator()(const std::size_t ix, const std::size_t iy) noexcept
+    {
+        return reference(bits_[iy * bytes_per_line_ + (ix >> 3u)],
+                         static_cast<std::uint8_t>(0x80u >> (ix & 7u)));
+    }
+    const_reference
+    operator()(const std::size_t ix, const std::size_t iy) const noexcept
+    {
+        return bit_pixel(((bits_[iy * bytes_per_line_ + (ix >> 3u)] <<
+                          (ix & 7u)) & 0x80u) != 0);
+    }
+
+    reference at(const std::size_t ix, const std::size_t iy)
+    {
+        this->check_index(ix, iy);
+        return (*this)(ix, iy);
+    }
+    const_reference at(const std::size_t ix, const std::size_t iy) const
+    {
+        this->check_index(ix, iy);
+        return (*this)(ix, iy);
+    }
+
+    // a row is `bytes_per_line()` bytes, same as a line of P4 payload.
+    std::uint8_t*       row_data(const std::size_t iy)       noexcept
+    {return bits_.data() + iy * bytes_per_line_;}
+    std::uint8_t const* row_data(const std::size_t iy) const noexcept
+    {return bits_.data() + iy * bytes_per_line_;}
+
+    std::uint8_t*       data()       noexcept {return bits_.data();}
+    std::uint8_t const* data() const noexcept {return bits_.data();}
+
+    std::size_t width()  const noexcept {return nx_;}
+    std::size_t height() const noexcept {return ny_;}
+    std::size_t x_size() const noexcept {return nx_;}
+    std::size_t y_size() const noexcept {return ny_;}
+    std::size_t size()   const noexcept {return nx_ * ny_;}
+
+    std::size_t bytes_per_line() const noexcept {return bytes_per_line_;}
+    std::size_t bytes()          const noexcept {return bits_.size();}
+
+    // the bits after the last pixel in a row are kept zero, so that images
+    // can be compared bytewise.
+    void clear_padding() noexcept
+    {
+        if(nx_ % 8 == 0) {return;}
+        const std::uint8_t mask = static_cast<std::uint8_t>(0xFFu << (8 - nx_ % 8));
+        for(std::size_t j=0; j<ny_; ++j)
+        {
+            bits_[(j + 1) * bytes_per_line_ - 1] &= mask;
+        }
+        return;
+    }
+
+    bool operator==(const packed_bit_image& rhs) const noexcept
+    {
+        return nx_ == rhs.nx_ && ny_ == rhs.ny_ && bits_ == rhs.bits_;
+    }
+    bool operator!=(const packed_bit_image& rhs) const noexcept
+    {
+        return !(*this == rhs);
+    }
+
+  private:
+
+    void check_index(const std::size_t ix, const std::size_t iy) const
+    {
+        if(nx_ <= ix || ny_ <= iy)
+        {
+            throw std::out_of_range("pnm::packed_bit_image::at: index (" +
+                std::to_string(ix) + ", " + std::to_string(iy) +
+                ") exceeds the size (" + std::to_string(nx_) + ", " +
+                std::to_string(ny_) + ")");
+        }
+        return;
+    }
+
+  private:
+    std::size_t    nx_, ny_, bytes_per_line_;
+    container_type bits_;
+};
+
+// --------------------------------------------------------------------------
+//                     _   * read_(pbm|pgm|ppm)_(ascii|binary)
+//  _ __ ___  __ _  __| |    - the most specific functions
+// | '_// _ \/ _` |/ _` |  * read_(pbm|pgm|ppm)
+// | | (  __/ (_| | (_| |    - detects ascii or binary format and read
+// |_|  \___|\__,_|\__,_|  * read
+//                           - depends on what pixel you will specify
+// --------------------------------------------------------------------------
+
+// reads only the header. the payload is not touched.
+inline header read_header(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_header: file open error: " + fname);
+    }
+    return detail::read_header(ifs, "pnm::read_header", fname);
+}
+inline header read_header(std::istream& is)
+{
+    return detail::read_header(is, "pnm::read_header", "(stream)");
+}
+inline header read_header(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_header(is, "pnm::read_header", "(memory)");
 }
 
-template<typename Alloc>
-void write_ppm_binary(const std::string& fname,
-                      const image<rgb_pixel, Alloc>& img)
+namespace detail
 {
-    std::ofstream ofs(fname, std::ios::binary);
-    if(!ofs.good())
+// reads a header and checks the magic number.
+inline header expect_header(std::istream& is, const char magic,
+        const char* func, const char* kind, const std::string& fname)
+{
+    const header hdr = read_header(is, func, fname);
+    if(hdr.magic != magic)
     {
-        throw std::runtime_error(
-                "pnm::write_ppm_binary: file open error: " + fname);
+        throw std::runtime_error(std::string(func) + ": " + fname +
+            " is not a " + kind + " file: magic number is P" + hdr.magic);
     }
+    return hdr;
+}
 
-    ofs << "P6\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
+// decode_* read the payload that follows the header `hdr`.
+// `fname` is used only in error messages.
+//
+// the payload is decoded as `Native`, the pixel type that matches the file,
+// and stored into an image of the requested pixel type. `decode_rows(dst, n)`
+// decodes the next `n` rows into `dst`. if the two types are the same, the
+// rows are decoded into the image directly. otherwise, they are decoded into
+// a small buffer and converted chunk by chunk, so that no intermediate image
+// is allocated. `Image` is either image or aligned_image; padded rows are
+// decoded one by one.
+template<typename Native, typename Image, typename Decoder>
+void decode_into_impl(Image& img, Decoder& decode_rows,
+                      const bool bottom_up, std::true_type /*same pixel*/)
+{
+    const std::size_t x = img.x_size();
+    const std::size_t y = img.y_size();
+    if(img.size() == 0){return;}
 
-    for(std::size_t j=0; j<img.y_size(); ++j)
+    if(img.stride() == x)
+    {
+        decode_rows(img.row_ptr(0), y);
+    }
+    else // rows are padded
     {
-        for(std::size_t i=0; i<img.x_size(); ++i)
+        for(std::size_t j=0; j<y; ++j)
         {
-            const auto& pixel = img(i, j);
-            ofs.write(reinterpret_cast<const char*>(std::addressof(pixel.red)),   1);
-            ofs.write(reinterpret_cast<const char*>(std::addressof(pixel.green)), 1);
-            ofs.write(reinterpret_cast<const char*>(std::addressof(pixel.blue)),  1);
+            decode_rows(img.row_ptr(j), 1);
         }
     }
-    return ;
+    if(bottom_up)
+    {
+        for(std::size_t j=0, k=y-1; j<k; ++j, --k)
+        {
+            std::swap_ranges(img.row_ptr(j), img.row_ptr(j) + x, img.row_ptr(k));
+        }
+    }
+    return;
+}
+template<typename Native, typename Image, typename Decoder>
+void decode_into_impl(Image& img, Decoder& decode_rows,
+                      const bool bottom_up, std::false_type /*same pixel*/)
+{
+    using pixel_type = typename Image::pixel_type;
+    const std::size_t x = img.x_size();
+    const std::size_t y = img.y_size();
+    if(img.size() == 0){return;}
+
+    const std::size_t lines = std::min(y, lines_per_chunk(x * sizeof(Native)));
+    std::vector<Native> buf(x * lines);
+    for(std::size_t j=0; j<y; j+=lines)
+    {
+        const std::size_t n = std::min(lines, y - j);
+        decode_rows(buf.data(), n);
+        for(std::size_t k=0; k<n; ++k)
+        {
+            const Native* src = buf.data() + k * x;
+            pixel_type* dst = img.row_ptr(bottom_up ? y-1-(j+k) : j+k);
+            for(std::size_t i=0; i<x; ++i)
+            {
+                dst[i] = convert_impl<Native, pixel_type>::invoke(src[i]);
+            }
+        }
+    }
+    return;
+}
+// rows are stored from top to bottom unless `bottom_up` is set.
+template<typename Native, typename Image, typename Decoder>
+void decode_into(Image& img, Decoder decode_rows, const bool bottom_up = false)
+{
+    decode_into_impl<Native>(img, decode_rows, bottom_up,
+        std::is_same<Native, typename Image::pixel_type>{});
 }
 
-template<typename Alloc>
-void write_ppm(const std::string& fname, const image<rgb_pixel, Alloc>& img,
-               const format fmt)
+// pbm payload is always decoded as bit_pixel.
+template<typename Image>
+void decode_pbm_ascii(std::istream& is, const header& hdr,
+                      const std::string& fname, Image& img)
 {
-    if(fmt == format::ascii)
+    using namespace detail::literals;
+    const std::size_t x = hdr.width;
+    const std::size_t y = hdr.height;
+
+    img.resize(x, y);
+
+    detail::ascii_tokenizer tokens(is, "pnm::read_pbm_ascii", fname);
+    decode_into<bit_pixel>(img, [&tokens, x](bit_pixel* dst, const std::size_t n)
     {
-        return write_ppm_ascii(fname, img);
+        std::size_t i=0, pix=0;
+        for(; i < n * x && tokens.next(pix); ++i)
+        {
+            dst[i] = bit_pixel(pix != 0);
+        }
+        std::fill(dst + i, dst + n * x, bit_pixel());
+    });
+
+    std::size_t pix=0;
+    if(tokens.next(pix))
+    {
+        throw std::runtime_error("pnm::read_pbm_ascii: file "  +
+            fname + " contains too many pixels: "_str +
+            std::to_string(x * y) + " pixels for "_str  +
+            std::to_string(x)   + "x"_str             +
+            std::to_string(y)   + " image"_str);
     }
-    else if(fmt == format::binary)
+    return;
+}
+template<typename Image>
+void decode_pbm_binary(std::istream& is, const header& hdr,
+                       const std::string& fname, Image& img)
+{
+    const std::size_t x = hdr.width;
+    const std::size_t y = hdr.height;
+
+    img.resize(x, y);
+
+    const std::size_t bytes_per_line = (x + 7) / 8;
+    const std::size_t lines = detail::lines_per_chunk(bytes_per_line);
+    std::vector<std::uint8_t> buf;
+
+    decode_into<bit_pixel>(img, [&](bit_pixel* dst, const std::size_t rows)
     {
-        return write_ppm_binary(fname, img);
+        buf.resize(bytes_per_line * std::min(lines, rows));
+        for(std::size_t j=0; j<rows; j+=lines)
+        {
+            const std::size_t n = std::min(lines, rows - j);
+            detail::read_payload(is, reinterpret_cast<char*>(buf.data()),
+                    n * bytes_per_line, "pnm::read_pbm_binary", fname);
+            for(std::size_t k=0; k<n; ++k)
+            {
+                detail::unpack_bits(buf.data() + k * bytes_per_line,
+                                    dst + (j+k) * x, x);
+            }
+        }
+    });
+    return;
+}
+
+// P4 payload has the same layout as packed_bit_image, so it is read at once.
+template<typename Alloc>
+packed_bit_image<Alloc>
+decode_pbm_packed(std::istream& is, const header& hdr, const std::string& fname)
+{
+    if(hdr.magic == '1')
+    {
+        image<bit_pixel> unpacked;
+        decode_pbm_ascii(is, hdr, fname, unpacked);
+        return packed_bit_image<Alloc>(unpacked);
     }
-    throw std::runtime_error("pnm::write_ppm: "
-            "invalid format flag (neither ascii nor binary)");
+    packed_bit_image<Alloc> img(hdr.width, hdr.height);
+    if(img.bytes() == 0){return img;}
+
+    detail::read_payload(is, reinterpret_cast<char*>(img.data()), img.bytes(),
+                         "pnm::read_pbm_packed", fname);
+    img.clear_padding();
+    return img;
 }
 
 template<typename Alloc>
-inline void write(const std::string& fname, const image<bit_pixel, Alloc>& img,
-           const format fmt)
+packed_bit_image<Alloc> read_pbm_packed(std::istream& is, const std::string& fname)
 {
-    return write_pbm(fname, img, fmt);
+    const header hdr = read_header(is, "pnm::read_pbm_packed", fname);
+    if(hdr.magic != '1' && hdr.magic != '4')
+    {
+        throw std::runtime_error("pnm::read_pbm_packed: " + fname +
+            " is not a pbm file: magic number is P" + hdr.magic);
+    }
+    return decode_pbm_packed<Alloc>(is, hdr, fname);
+}
+
+// pgm, ppm and pam payload is decoded as `Native`, so that
+// decode_pgm_*<gray16_pixel> keeps 16-bit precision.
+template<typename Native, typename Image>
+void decode_pgm_ascii(std::istream& is, const header& hdr,
+                      const std::string& fname, Image& img)
+{
+    using namespace detail::literals;
+    using value_type = typename Native::value_type;
+    const std::size_t x = hdr.width;
+    const std::size_t y = hdr.height;
+
+    img.resize(x, y);
+    const detail::basic_gain_table<value_type> gain(hdr.maxval);
+
+    detail::ascii_tokenizer tokens(is, "pnm::read_pgm_ascii", fname);
+    decode_into<Native>(img, [&](Native* dst, const std::size_t n)
+    {
+        std::size_t i=0, pix=0;
+        for(; i < n * x && tokens.next(pix); ++i)
+        {
+            dst[i] = Native(gain(pix));
+        }
+        std::fill(dst + i, dst + n * x, Native());
+    });
+
+    std::size_t pix=0;
+    if(tokens.next(pix))
+    {
+        throw std::runtime_error("pnm::read_pgm_ascii: file "  +
+            fname + "contains too many pixels: "_str  +
+            std::to_string(x * y) + " pixels for "_str  +
+            std::to_string(x)   + "x"_str             +
+            std::to_string(y)   + " image"_str);
+    }
+    return;
+}
+
+template<typename Native, typename Image>
+void decode_ppm_ascii(std::istream& is, const header& hdr,
+                      const std::string& fname, Image& img)
+{
+    using namespace detail::literals;
+    using value_type = typename Native::value_type;
+    const std::size_t x = hdr.width;
+    const std::size_t y = hdr.height;
+
+    img.resize(x, y);
+    const detail::basic_gain_table<value_type> gain(hdr.maxval);
+
+    detail::ascii_tokenizer tokens(is, "pnm::read_ppm_ascii", fname);
+    decode_into<Native>(img, [&](Native* dst, const std::size_t n)
+    {
+        std::size_t i=0, R=0, G=0, B=0;
+        for(; i < n * x && tokens.next(R) && tokens.next(G) && tokens.next(B); ++i)
+        {
+            dst[i] = Native(gain(R), gain(G), gain(B));
+        }
+        std::fill(dst + i, dst + n * x, Native());
+    });
+
+    std::size_t R=0, G=0, B=0;
+    if(tokens.next(R) && tokens.next(G) && tokens.next(B))
+    {
+        throw std::runtime_error("pnm::read_ppm_ascii: file " +
+            fname + "contains too many pixels: "_str +
+            std::to_string(x * y) + " pixels for "_str +
+            std::to_string(x)   + "x"_str            +
+            std::to_string(y)   + " image"_str);
+    }
+    return;
+}
+
+// pgm, ppm and pam binary payloads are sequences of samples.
+template<typename Native, typename Image>
+void decode_samples(std::istream& is, const header& hdr, const char* func,
+                    const std::string& fname, Image& img)
+{
+    using value_type = typename Native::value_type;
+    const std::size_t x = hdr.width;
+
+    img.resize(x, hdr.height);
+    if(img.size() == 0){return;}
+
+    const detail::basic_gain_table<value_type> gain(hdr.maxval);
+    decode_into<Native>(img, [&](Native* dst, const std::size_t n)
+    {
+        detail::read_samples(is, reinterpret_cast<value_type*>(dst),
+                n * x * Native::colors, hdr.maxval, gain, func, fname);
+    });
+    return;
+}
+template<typename Native, typename Image>
+void decode_pgm_binary(std::istream& is, const header& hdr,
+                       const std::string& fname, Image& img)
+{
+    decode_samples<Native>(is, hdr, "pnm::read_pgm_binary", fname, img);
+}
+template<typename Native, typename Image>
+void decode_ppm_binary(std::istream& is, const header& hdr,
+                       const std::string& fname, Image& img)
+{
+    decode_samples<Native>(is, hdr, "pnm::read_ppm_binary", fname, img);
+}
+template<typename Native, typename Image>
+void decode_pam(std::istream& is, const header& hdr,
+                const std::string& fname, Image& img)
+{
+    if(hdr.depth != Native::colors)
+    {
+        throw std::runtime_error("pnm::read_pam: file " + fname + " has depth " +
+            std::to_string(hdr.depth) + ", but pixels have " +
+            std::to_string(Native::colors) + " samples");
+    }
+    decode_samples<Native>(is, hdr, "pnm::read_pam", fname, img);
+}
+
+// pfm stores 4-byte floats in the byte order indicated by the sign of scale,
+// and the rows from bottom to top.
+template<typename Native, typename Image>
+void decode_pfm(std::istream& is, const header& hdr,
+                const std::string& fname, Image& img)
+{
+    static_assert(sizeof(Native) == sizeof(float) * Native::colors,
+                  "pixels must be stored in the same layout as the file");
+    const std::size_t x = hdr.width;
+#ifdef PNM_BIG_ENDIAN
+    const bool needs_swap = (hdr.scale < 0.0);
+#else
+    const bool needs_swap = (hdr.scale > 0.0);
+#endif
+
+    img.resize(x, hdr.height);
+    decode_into<Native>(img, [&](Native* dst, const std::size_t n)
+    {
+        const std::size_t samples = n * x * Native::colors;
+        read_payload(is, reinterpret_cast<char*>(dst), samples * sizeof(float),
+                     "pnm::read_pfm", fname);
+        if(needs_swap) {reverse_bytes32(dst, samples);}
+    }, /*bottom_up = */ true);
+    return;
 }
+
 template<typename Alloc>
-inline void write(const std::string& fname, const image<gray_pixel, Alloc>& img,
-           const format fmt)
+image<bit_pixel, Alloc> read_pbm(std::istream& is, const std::string& fname)
 {
-    return write_pgm(fname, img, fmt);
+    const header hdr = read_header(is, "pnm::read_pbm", fname);
+    image<bit_pixel, Alloc> img;
+    switch(hdr.magic)
+    {
+        case '1': {decode_pbm_ascii (is, hdr, fname, img); break;}
+        case '4': {decode_pbm_binary(is, hdr, fname, img); break;}
+        default:
+        {
+            throw std::runtime_error("pnm::read_pbm: not a pbm file: "
+                    "magic number is P" + std::string(1, hdr.magic));
+        }
+    }
+    return img;
 }
 template<typename Alloc>
-inline void write(const std::string& fname, const image<rgb_pixel, Alloc>& img,
-           const format fmt)
+image<gray_pixel, Alloc> read_pgm(std::istream& is, const std::string& fname)
 {
-    return write_ppm(fname, img, fmt);
+    const header hdr = read_header(is, "pnm::read_pgm", fname);
+    image<gray_pixel, Alloc> img;
+    switch(hdr.magic)
+    {
+        case '2': {decode_pgm_ascii <gray_pixel>(is, hdr, fname, img); break;}
+        case '5': {decode_pgm_binary<gray_pixel>(is, hdr, fname, img); break;}
+        default:
+        {
+            throw std::runtime_error("pnm::read_pgm: " + fname +
+                " is not a pgm file: magic number is P" + hdr.magic);
+        }
+    }
+    return img;
+}
+template<typename Alloc>
+image<rgb_pixel, Alloc> read_ppm(std::istream& is, const std::string& fname)
+{
+    const header hdr = read_header(is, "pnm::read_ppm", fname);
+    image<rgb_pixel, Alloc> img;
+    switch(hdr.magic)
+    {
+        case '3': {decode_ppm_ascii <rgb_pixel>(is, hdr, fname, img); break;}
+        case '6': {decode_ppm_binary<rgb_pixel>(is, hdr, fname, img); break;}
+        default:
+        {
+            throw std::runtime_error("pnm::read_ppm: " + fname +
+                " is not a ppm file: magic number is P" + hdr.magic);
+        }
+    }
+    return img;
+}
+} // detail
+
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm_ascii(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(
+                "pnm::read_pbm_ascii: file open error: " + fname);
+    }
+    const header hdr = detail::expect_header(
+            ifs, '1', "pnm::read_pbm_ascii", "pbm", fname);
+    image<bit_pixel, Alloc> img;
+    detail::decode_pbm_ascii(ifs, hdr, fname, img);
+    return img;
+}
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm_ascii(std::istream& is)
+{
+    const header hdr = detail::expect_header(
+            is, '1', "pnm::read_pbm_ascii", "pbm", "(stream)");
+    image<bit_pixel, Alloc> img;
+    detail::decode_pbm_ascii(is, hdr, "(stream)", img);
+    return img;
+}
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm_binary(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(
+                "pnm::read_pbm_binary: file open error: " + fname);
+    }
+    const header hdr = detail::expect_header(
+            ifs, '4', "pnm::read_pbm_binary", "binary pbm", fname);
+    image<bit_pixel, Alloc> img;
+    detail::decode_pbm_binary(ifs, hdr, fname, img);
+    return img;
+}
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm_binary(std::istream& is)
+{
+    const header hdr = detail::expect_header(
+            is, '4', "pnm::read_pbm_binary", "binary pbm", "(stream)");
+    image<bit_pixel, Alloc> img;
+    detail::decode_pbm_binary(is, hdr, "(stream)", img);
+    return img;
+}
+
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_pbm: file open error: " + fname);
+    }
+    return detail::read_pbm<Alloc>(ifs, fname);
+}
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm(std::istream& is)
+{
+    return detail::read_pbm<Alloc>(is, "(stream)");
+}
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_pbm<Alloc>(is, "(memory)");
+}
+
+template<typename Alloc = std::allocator<std::uint8_t>>
+packed_bit_image<Alloc> read_pbm_packed(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(
+                "pnm::read_pbm_packed: file open error: " + fname);
+    }
+    return detail::read_pbm_packed<Alloc>(ifs, fname);
+}
+template<typename Alloc = std::allocator<std::uint8_t>>
+packed_bit_image<Alloc> read_pbm_packed(std::istream& is)
+{
+    return detail::read_pbm_packed<Alloc>(is, "(stream)");
+}
+template<typename Alloc = std::allocator<std::uint8_t>>
+packed_bit_image<Alloc> read_pbm_packed(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_pbm_packed<Alloc>(is, "(memory)");
+}
+
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm_ascii(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(
+                "pnm::read_pgm_ascii: file open error: " + fname);
+    }
+    const header hdr = detail::expect_header(
+            ifs, '2', "pnm::read_pgm_ascii", "pgm", fname);
+    image<gray_pixel, Alloc> img;
+    detail::decode_pgm_ascii<gray_pixel>(ifs, hdr, fname, img);
+    return img;
+}
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm_ascii(std::istream& is)
+{
+    const header hdr = detail::expect_header(
+            is, '2', "pnm::read_pgm_ascii", "pgm", "(stream)");
+    image<gray_pixel, Alloc> img;
+    detail::decode_pgm_ascii<gray_pixel>(is, hdr, "(stream)", img);
+    return img;
+}
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm_binary(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(
+                "pnm::read_pgm_binary: file open error: " + fname);
+    }
+    const header hdr = detail::expect_header(
+            ifs, '5', "pnm::read_pgm_binary", "binary pgm", fname);
+    image<gray_pixel, Alloc> img;
+    detail::decode_pgm_binary<gray_pixel>(ifs, hdr, fname, img);
+    return img;
+}
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm_binary(std::istream& is)
+{
+    const header hdr = detail::expect_header(
+            is, '5', "pnm::read_pgm_binary", "binary pgm", "(stream)");
+    image<gray_pixel, Alloc> img;
+    detail::decode_pgm_binary<gray_pixel>(is, hdr, "(stream)", img);
+    return img;
+}
+
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_pgm: file open error: " + fname);
+    }
+    return detail::read_pgm<Alloc>(ifs, fname);
+}
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm(std::istream& is)
+{
+    return detail::read_pgm<Alloc>(is, "(stream)");
+}
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_pgm<Alloc>(is, "(memory)");
+}
+
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm_ascii(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(
+                "pnm::read_ppm_ascii: file open error: " + fname);
+    }
+    const header hdr = detail::expect_header(
+            ifs, '3', "pnm::read_ppm_ascii", "ppm", fname);
+    image<rgb_pixel, Alloc> img;
+    detail::decode_ppm_ascii<rgb_pixel>(ifs, hdr, fname, img);
+    return img;
+}
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm_ascii(std::istream& is)
+{
+    const header hdr = detail::expect_header(
+            is, '3', "pnm::read_ppm_ascii", "ppm", "(stream)");
+    image<rgb_pixel, Alloc> img;
+    detail::decode_ppm_ascii<rgb_pixel>(is, hdr, "(stream)", img);
+    return img;
+}
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm_binary(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(
+                "pnm::read_ppm_binary: file open error: " + fname);
+    }
+    const header hdr = detail::expect_header(
+            ifs, '6', "pnm::read_ppm_binary", "binary ppm", fname);
+    image<rgb_pixel, Alloc> img;
+    detail::decode_ppm_binary<rgb_pixel>(ifs, hdr, fname, img);
+    return img;
+}
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm_binary(std::istream& is)
+{
+    const header hdr = detail::expect_header(
+            is, '6', "pnm::read_ppm_binary", "binary ppm", "(stream)");
+    image<rgb_pixel, Alloc> img;
+    detail::decode_ppm_binary<rgb_pixel>(is, hdr, "(stream)", img);
+    return img;
+}
+
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_ppm: file open error: " + fname);
+    }
+    return detail::read_ppm<Alloc>(ifs, fname);
+}
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm(std::istream& is)
+{
+    return detail::read_ppm<Alloc>(is, "(stream)");
+}
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_ppm<Alloc>(is, "(memory)");
+}
+
+namespace detail
+{
+template<typename Pixel, typename Alloc, typename FromPixel, typename FromAlloc>
+struct convert_image_impl
+{
+    static image<Pixel, Alloc> invoke(const image<FromPixel, FromAlloc>& img)
+    {
+        image<Pixel, Alloc> retval(img.x_size(), img.y_size());
+        for(std::size_t i=0; i<img.size(); ++i)
+        {
+            retval.raw_access(i) =
+                convert_impl<FromPixel, Pixel>::invoke(img.raw_access(i));
+        }
+        return retval;
+    }
+};
+// if `from` and `to` has the same type, no conversion is needed.
+template<typename Pixel, typename Alloc>
+struct convert_image_impl<Pixel, Alloc, Pixel, Alloc>
+{
+    static inline image<Pixel, Alloc>
+    invoke(const image<Pixel, Alloc>& img) {return img;}
+    static inline image<Pixel, Alloc>
+    invoke(image<Pixel, Alloc>&& img) noexcept {return std::move(img);}
+};
+}// detail
+
+template<typename Pixel, typename Alloc, typename FromPixel, typename FromAlloc>
+image<Pixel, Alloc> convert_image(const image<FromPixel, FromAlloc>& img)
+{
+    return detail::convert_image_impl<Pixel, Alloc, FromPixel, FromAlloc
+        >::invoke(img);
+}
+template<typename Pixel, typename Alloc, typename FromPixel, typename FromAlloc>
+image<Pixel, Alloc> convert_image(image<FromPixel, FromAlloc>&& img)
+{
+    return detail::convert_image_impl<Pixel, Alloc, FromPixel, FromAlloc
+        >::invoke(std::move(img));
+}
+template<typename Pixel, typename Alloc = std::allocator<Pixel>, typename T>
+image<Pixel, Alloc> convert_image(const basic_image_view<T>& view,
+                                  const narrowing_policy& policy)
+{
+    using from_pixel = typename basic_image_view<T>::pixel_type;
+    image<Pixel, Alloc> retval(view.x_size(), view.y_size());
+    if(retval.size() == 0) {return retval;}
+    if(view.is_contiguous())
+    {
+        detail::narrowing_impl<from_pixel, Pixel>::invoke(
+                view.row_ptr(0), retval.data(), retval.size(), policy);
+        return retval;
+    }
+    for(std::size_t j=0; j<view.y_size(); ++j)
+    {
+        detail::narrowing_impl<from_pixel, Pixel>::invoke(view.row_ptr(j),
+                std::addressof(retval(0, j)), view.x_size(), policy);
+    }
+    return retval;
+}
+template<typename Pixel, typename Alloc = std::allocator<Pixel>,
+         typename FromPixel, typename FromAlloc>
+image<Pixel, Alloc> convert_image(const image<FromPixel, FromAlloc>& img,
+                                  const narrowing_policy& policy)
+{
+    return convert_image<Pixel, Alloc>(const_image_view<FromPixel>(img), policy);
+}
+template<typename Pixel, typename Alloc = std::allocator<Pixel>, typename T>
+image<Pixel, Alloc> convert_image(const basic_image_view<T>& view)
+{
+    using from_pixel = typename basic_image_view<T>::pixel_type;
+    image<Pixel, Alloc> retval(view.x_size(), view.y_size());
+    for(std::size_t j=0; j<view.y_size(); ++j)
+    {
+        for(std::size_t i=0; i<view.x_size(); ++i)
+        {
+            retval(i, j) = detail::convert_impl<from_pixel, Pixel>::invoke(view(i, j));
+        }
+    }
+    return retval;
+}
+
+// the parallel overloads convert bands of rows on the executor of `par`.
+// images smaller than about 1 MiB per task are converted on the calling
+// thread.
+namespace detail
+{
+template<typename Pixel, typename Alloc, typename T, typename ConvertRow>
+image<Pixel, Alloc> convert_image_parallel(const basic_image_view<T>& view,
+        const parallel_policy& par, ConvertRow convert_row)
+{
+    image<Pixel, Alloc> retval(view.x_size(), view.y_size());
+    const std::size_t y = view.y_size();
+    const std::size_t max_bands = std::min(std::min(thread_count(par), y),
+        std::max<std::size_t>(1, retval.size() * sizeof(Pixel) / binary_chunk_size));
+    if(retval.size() == 0) {return retval;}
+
+    const std::size_t rows  = (y + max_bands - 1) / max_bands;
+    const std::size_t bands = (y + rows - 1) / rows;
+    const auto convert_band = [&](const std::size_t i) {
+        for(std::size_t j=i*rows, last=std::min(y, (i+1)*rows); j<last; ++j)
+        {
+            convert_row(view.row_ptr(j), retval.row_ptr(j), view.x_size());
+        }
+    };
+    if(bands == 1)
+    {
+        convert_band(0);
+        return retval;
+    }
+    parallel_for(par, bands, convert_band);
+    return retval;
+}
+} // detail
+
+template<typename Pixel, typename Alloc = std::allocator<Pixel>, typename T>
+image<Pixel, Alloc> convert_image(const basic_image_view<T>& view,
+        const narrowing_policy& policy, const parallel_policy& par)
+{
+    using from_pixel = typename basic_image_view<T>::pixel_type;
+    return detail::convert_image_parallel<Pixel, Alloc>(view, par,
+        [&policy](const from_pixel* src, Pixel* dst, const std::size_t n) {
+            detail::narrowing_impl<from_pixel, Pixel>::invoke(src, dst, n, policy);
+        });
+}
+template<typename Pixel, typename Alloc = std::allocator<Pixel>, typename T>
+image<Pixel, Alloc> convert_image(const basic_image_view<T>& view,
+                                  const parallel_policy& par)
+{
+    using from_pixel = typename basic_image_view<T>::pixel_type;
+    return detail::convert_image_parallel<Pixel, Alloc>(view, par,
+        [](const from_pixel* src, Pixel* dst, const std::size_t n) {
+            for(std::size_t i=0; i<n; ++i)
+            {
+                dst[i] = detail::convert_impl<from_pixel, Pixel>::invoke(src[i]);
+            }
+        });
+}
+template<typename Pixel, typename Alloc = std::allocator<Pixel>,
+         typename FromPixel, typename FromAlloc>
+image<Pixel, Alloc> convert_image(const image<FromPixel, FromAlloc>& img,
+        const narrowing_policy& policy, const parallel_policy& par)
+{
+    return convert_image<Pixel, Alloc>(const_image_view<FromPixel>(img), policy, par);
+}
+template<typename Pixel, typename Alloc = std::allocator<Pixel>,
+         typename FromPixel, typename FromAlloc>
+image<Pixel, Alloc> convert_image(const image<FromPixel, FromAlloc>& img,
+                                  const parallel_policy& par)
+{
+    return convert_image<Pixel, Alloc>(const_image_view<FromPixel>(img), par);
+}
+
+namespace detail
+{
+// if 16-bit pixels are requested, samples are decoded in 16-bit.
+template<typename Pixel>
+using sample_type_for = typename std::conditional<
+    sizeof(typename Pixel::value_type) == 2, std::uint16_t, std::uint8_t
+    >::type;
+
+// pam files are decoded as the pixel that has the same depth, and then
+// converted into the requested one row by row.
+template<typename Image>
+void decode_pam_as(std::istream& is, const header& hdr,
+                   const std::string& fname, Image& img)
+{
+    using sample_type = sample_type_for<typename Image::pixel_type>;
+    switch(hdr.depth)
+    {
+        case 1: {decode_pam<basic_pixel<sample_type, 1>>(is, hdr, fname, img); break;}
+        case 2: {decode_pam<basic_pixel<sample_type, 2>>(is, hdr, fname, img); break;}
+        case 3: {decode_pam<basic_pixel<sample_type, 3>>(is, hdr, fname, img); break;}
+        case 4: {decode_pam<basic_pixel<sample_type, 4>>(is, hdr, fname, img); break;}
+        default:
+        {
+            throw std::runtime_error("pnm::read_pam: file " + fname +
+                " has depth " + std::to_string(hdr.depth) +
+                ", which is not supported");
+        }
+    }
+    return;
+}
+
+template<typename Pixel, typename Alloc>
+image<Pixel, Alloc> read_pam(std::istream& is, const std::string& fname)
+{
+    const header hdr = read_header(is, "pnm::read_pam", fname);
+    if(hdr.magic != '7')
+    {
+        throw std::runtime_error("pnm::read_pam: " + fname +
+            " is not a pam file: magic number is P" + hdr.magic);
+    }
+    image<Pixel, Alloc> img;
+    decode_pam_as(is, hdr, fname, img);
+    return img;
+}
+
+template<typename Pixel, typename Alloc>
+image<Pixel, Alloc> read_pfm(std::istream& is, const std::string& fname)
+{
+    const header hdr = read_header(is, "pnm::read_pfm", fname);
+    image<Pixel, Alloc> img;
+    switch(hdr.magic)
+    {
+        case 'f': {decode_pfm<grayf_pixel>(is, hdr, fname, img); break;}
+        case 'F': {decode_pfm< rgbf_pixel>(is, hdr, fname, img); break;}
+        default:
+        {
+            throw std::runtime_error("pnm::read_pfm: " + fname +
+                " is not a pfm file: magic number is P" + hdr.magic);
+        }
+    }
+    return img;
+}
+
+// decodes any of the formats into `img`, an image or an aligned_image.
+// since every decoder resizes `img` to the size of the file and overwrites
+// all the pixels, the buffer of `img` is reused if it already has the same
+// size.
+template<typename Image>
+void decode_as(std::istream& is, const header& hdr, const std::string& fname,
+               Image& img, const char* func)
+{
+    using sample_type = sample_type_for<typename Image::pixel_type>;
+    using gray_type = basic_pixel<sample_type, 1>;
+    using  rgb_type = basic_pixel<sample_type, 3>;
+
+    switch(hdr.magic)
+    {
+        case '1': {decode_pbm_ascii (is, hdr, fname, img); break;}
+        case '2': {decode_pgm_ascii <gray_type>(is, hdr, fname, img); break;}
+        case '3': {decode_ppm_ascii < rgb_type>(is, hdr, fname, img); break;}
+        case '4': {decode_pbm_binary(is, hdr, fname, img); break;}
+        case '5': {decode_pgm_binary<gray_type>(is, hdr, fname, img); break;}
+        case '6': {decode_ppm_binary< rgb_type>(is, hdr, fname, img); break;}
+        case '7': {decode_pam_as(is, hdr, fname, img); break;}
+        case 'f': {decode_pfm<grayf_pixel>(is, hdr, fname, img); break;}
+        case 'F': {decode_pfm< rgbf_pixel>(is, hdr, fname, img); break;}
+        default:
+        {
+            throw std::runtime_error(std::string(func) + ": " + fname +
+                " is not any of pnm format: magic number is P" + hdr.magic);
+        }
+    }
+    return;
+}
+template<typename Image>
+header read_into(std::istream& is, const std::string& fname,
+                 Image& img, const char* func)
+{
+    const header hdr = read_header(is, func, fname);
+    decode_as(is, hdr, fname, img, func);
+    return hdr;
+}
+
+template<typename Pixel, typename Alloc>
+image<Pixel, Alloc> read(std::istream& is, const std::string& fname)
+{
+    image<Pixel, Alloc> img;
+    read_into(is, fname, img, "pnm::read");
+    return img;
+}
+} // detail
+
+template<typename Pixel = rgb_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read: file open error: " + fname);
+    }
+    return detail::read<Pixel, Alloc>(ifs, fname);
+}
+template<typename Pixel = rgb_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read(std::istream& is)
+{
+    return detail::read<Pixel, Alloc>(is, "(stream)");
+}
+template<typename Pixel = rgb_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read<Pixel, Alloc>(is, "(memory)");
+}
+
+// read_into decodes a file into an existing image and returns its header.
+// the buffer of `img` is reused if the size of the file is the same, so
+// reading a sequence of same-size images allocates no memory.
+template<typename Pixel, typename Alloc>
+header read_into(const std::string& fname, image<Pixel, Alloc>& img)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_into: file open error: " + fname);
+    }
+    return detail::read_into(ifs, fname, img, "pnm::read_into");
+}
+template<typename Pixel, typename Alloc>
+header read_into(std::istream& is, image<Pixel, Alloc>& img)
+{
+    return detail::read_into(is, "(stream)", img, "pnm::read_into");
+}
+template<typename Pixel, typename Alloc>
+header read_into(const void* data, const std::size_t size,
+                 image<Pixel, Alloc>& img)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_into(is, "(memory)", img, "pnm::read_into");
+}
+
+// rows of aligned_image keep their padding.
+template<typename Pixel, std::size_t Alignment>
+header read_into(const std::string& fname, aligned_image<Pixel, Alignment>& img)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_into: file open error: " + fname);
+    }
+    return detail::read_into(ifs, fname, img, "pnm::read_into");
+}
+template<typename Pixel, std::size_t Alignment>
+header read_into(std::istream& is, aligned_image<Pixel, Alignment>& img)
+{
+    return detail::read_into(is, "(stream)", img, "pnm::read_into");
+}
+template<typename Pixel, std::size_t Alignment>
+header read_into(const void* data, const std::size_t size,
+                 aligned_image<Pixel, Alignment>& img)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_into(is, "(memory)", img, "pnm::read_into");
+}
+
+template<typename Pixel = rgba_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read_pam(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_pam: file open error: " + fname);
+    }
+    return detail::read_pam<Pixel, Alloc>(ifs, fname);
+}
+template<typename Pixel = rgba_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read_pam(std::istream& is)
+{
+    return detail::read_pam<Pixel, Alloc>(is, "(stream)");
+}
+template<typename Pixel = rgba_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read_pam(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_pam<Pixel, Alloc>(is, "(memory)");
+}
+
+template<typename Pixel = rgbf_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read_pfm(const std::string& fname)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error("pnm::read_pfm: file open error: " + fname);
+    }
+    return detail::read_pfm<Pixel, Alloc>(ifs, fname);
+}
+template<typename Pixel = rgbf_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read_pfm(std::istream& is)
+{
+    return detail::read_pfm<Pixel, Alloc>(is, "(stream)");
+}
+template<typename Pixel = rgbf_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read_pfm(const void* data, const std::size_t size)
+{
+    detail::memory_streambuf buf(data, size);
+    std::istream is(&buf);
+    return detail::read_pfm<Pixel, Alloc>(is, "(memory)");
+}
+
+// --------------------------------------------------------------------------
+// parallel decoding of binary payloads. every row of P4, P5, P6, P7 and pfm
+// has the same number of bytes, so the rows are split into bands and each
+// thread reads its band by pread and decodes it into the image.
+// --------------------------------------------------------------------------
+
+namespace detail
+{
+// the number of bytes in a row of a binary payload, or 0 for ascii.
+inline std::size_t bytes_per_row(const header& hdr) noexcept
+{
+    switch(hdr.magic)
+    {
+        case '4': {return (hdr.width + 7) / 8;}
+        case '5': case '6': case '7':
+        {
+            return hdr.width * hdr.depth * ((hdr.maxval < 256) ? 1 : 2);
+        }
+        case 'f': case 'F': {return hdr.width * hdr.depth * sizeof(float);}
+        default: {return 0;}
+    }
+}
+
+// rows [first, first + height) of an image or aligned_image. decoders see it
+// as an image that is already resized.
+template<typename Image>
+class image_band
+{
+  public:
+    using pixel_type = typename Image::pixel_type;
+
+    image_band(Image& img, const std::size_t first, const std::size_t height) noexcept
+        : img_(std::addressof(img)), first_(first), ny_(height)
+    {}
+
+    pixel_type* row_ptr(const std::size_t iy) const noexcept
+    {
+        return img_->row_ptr(first_ + iy);
+    }
+
+    std::size_t x_size() const noexcept {return img_->x_size();}
+    std::size_t y_size() const noexcept {return ny_;}
+    std::size_t stride() const noexcept {return img_->stride();}
+    std::size_t size()   const noexcept {return img_->x_size() * ny_;}
+
+    void resize(const std::size_t, const std::size_t) noexcept {return;}
+
+  private:
+    Image*      img_;
+    std::size_t first_, ny_;
+};
+
+#ifdef PNM_HAS_POSIX_MMAP
+// reads [offset, offset + length) of a file by pread. pread does not move the
+// file position, so threads can share one file descriptor.
+class pread_streambuf : public std::streambuf
+{
+  public:
+    pread_streambuf(const int fd, const std::size_t offset, const std::size_t length)
+        : fd_(fd), pos_(offset), last_(offset + length), buf_(4096)
+    {}
+
+  protected:
+
+    int_type underflow() override
+    {
+        if(this->gptr() != this->egptr())
+        {
+            return traits_type::to_int_type(*this->gptr());
+        }
+        const std::size_t n = this->read_at(buf_.data(), buf_.size());
+        if(n == 0) {return traits_type::eof();}
+        this->setg(buf_.data(), buf_.data(), buf_.data() + n);
+        return traits_type::to_int_type(*this->gptr());
+    }
+
+    // a large read goes to `dst` directly, not through the buffer.
+    std::streamsize xsgetn(char* dst, const std::streamsize count) override
+    {
+        const std::size_t n = static_cast<std::size_t>(count);
+        const std::size_t buffered = std::min(n,
+                static_cast<std::size_t>(this->egptr() - this->gptr()));
+        std::copy(this->gptr(), this->gptr() + buffered, dst);
+        this->gbump(static_cast<int>(buffered));
+
+        std::size_t done = buffered;
+        while(done < n)
+        {
+            const std::size_t m = this->read_at(dst + done, n - done);
+            if(m == 0) {break;}
+            done += m;
+        }
+        return static_cast<std::streamsize>(done);
+    }
+
+  private:
+
+    std::size_t read_at(char* dst, const std::size_t count)
+    {
+        const std::size_t n = std::min(count, last_ - pos_);
+        while(n != 0)
+        {
+            const ::ssize_t r = ::pread(fd_, dst, n, static_cast<::off_t>(pos_));
+            if(r < 0 && errno == EINTR) {continue;}
+            if(r <= 0) {break;}
+            pos_ += static_cast<std::size_t>(r);
+            return static_cast<std::size_t>(r);
+        }
+        return 0;
+    }
+
+  private:
+    int               fd_;
+    std::size_t       pos_, last_;
+    std::vector<char> buf_;
+};
+
+// writes to a file from `offset` by pwrite. like pread_streambuf, threads can
+// share one file descriptor. a write error is reported as a failure of the
+// stream, not by an exception.
+class pwrite_streambuf : public std::streambuf
+{
+  public:
+    pwrite_streambuf(const int fd, const std::size_t offset)
+        : fd_(fd), pos_(offset), buf_(4096)
+    {
+        this->setp(buf_.data(), buf_.data() + buf_.size());
+    }
+
+  protected:
+
+    int_type overflow(const int_type c) override
+    {
+        if(!this->flush_buffer()) {return traits_type::eof();}
+        if(!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *this->pptr() = traits_type::to_char_type(c);
+            this->pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    // a large write goes to the file directly, not through the buffer.
+    std::streamsize xsputn(const char* src, const std::streamsize count) override
+    {
+        const std::size_t n = static_cast<std::size_t>(count);
+        if(n < buf_.size())
+        {
+            return std::streambuf::xsputn(src, count);
+        }
+        if(!this->flush_buffer() || !this->write_at(src, n)) {return 0;}
+        return count;
+    }
+
+    int sync() override
+    {
+        return this->flush_buffer() ? 0 : -1;
+    }
+
+  private:
+
+    bool flush_buffer()
+    {
+        const std::size_t n = static_cast<std::size_t>(this->pptr() - this->pbase());
+        this->setp(buf_.data(), buf_.data() + buf_.size());
+        return this->write_at(buf_.data(), n);
+    }
+
+    bool write_at(const char* src, std::size_t n)
+    {
+        while(n != 0)
+        {
+            const ::ssize_t r = ::pwrite(fd_, src, n, static_cast<::off_t>(pos_));
+            if(r < 0 && errno == EINTR) {continue;}
+            if(r <= 0) {return false;}
+            src  += r;
+            n    -= static_cast<std::size_t>(r);
+            pos_ += static_cast<std::size_t>(r);
+        }
+        return true;
+    }
+
+  private:
+    int               fd_;
+    std::size_t       pos_;
+    std::vector<char> buf_;
+};
+#endif // PNM_HAS_POSIX_MMAP
+
+// ascii payload has no row offsets, but a comment always ends at a newline.
+// so the payload is split after newlines, and the tokens in each chunk are
+// counted on each thread. the prefix sums of the counts give the first pixel
+// of each chunk. the chunk boundaries are moved forward to the first token of
+// a pixel, and then each chunk is parsed into its own pixels.
+
+// skips at most `n` tokens in the same way as ascii_tokenizer, and returns the
+// position right after the last one. `n` is decreased by the skipped tokens.
+inline const char* skip_tokens(const char* first, const char* const last,
+                               std::size_t& n) noexcept
+{
+    while(first != last && n != 0)
+    {
+        if(is_space(*first)) {++first; continue;}
+        if(*first == '#')
+        {
+            const char* const nl = static_cast<const char*>(std::memchr(
+                    first, '\n', static_cast<std::size_t>(last - first)));
+            first = (nl == nullptr) ? last : nl + 1;
+            continue;
+        }
+        while(first != last && !is_space(*first) && *first != '#') {++first;}
+        --n;
+    }
+    return first;
+}
+inline std::size_t count_tokens(const char* const first, const char* const last) noexcept
+{
+    std::size_t n = std::numeric_limits<std::size_t>::max();
+    skip_tokens(first, last, n);
+    return std::numeric_limits<std::size_t>::max() - n;
+}
+
+template<typename Native>
+inline void store_decoded(Native& dst, const Native& src, std::true_type) noexcept
+{
+    dst = src;
+}
+template<typename Native, typename Pixel>
+inline void store_decoded(Pixel& dst, const Native& src, std::false_type)
+{
+    dst = convert_impl<Native, Pixel>::invoke(src);
+}
+
+// `make(v)` makes a `Native` pixel from `Native::colors` values in `v`.
+template<typename Native, typename Image, typename MakePixel>
+void decode_ascii_parallel(const std::vector<char>& payload, const header& hdr,
+        const std::string& fname, Image& img, const parallel_policy& par,
+        const std::size_t max_chunks, MakePixel make, const char* func)
+{
+    using namespace detail::literals;
+    using pixel_type = typename Image::pixel_type;
+    using is_same_pixel = std::is_same<Native, pixel_type>;
+    constexpr std::size_t colors = Native::colors;
+    const std::size_t x = hdr.width;
+    const std::size_t y = hdr.height;
+    const char* const first = payload.data();
+    const char* const last  = first + payload.size();
+
+    std::vector<const char*> bounds(1, first);
+    for(std::size_t k=1; k<max_chunks; ++k)
+    {
+        const char* p = std::max(bounds.back(), first + payload.size() / max_chunks * k);
+        const char* const nl = static_cast<const char*>(
+                std::memchr(p, '\n', static_cast<std::size_t>(last - p)));
+        if(nl == nullptr) {break;}
+        p = nl + 1;
+        if(p != bounds.back() && p != last) {bounds.push_back(p);}
+    }
+    bounds.push_back(last);
+    const std::size_t chunks = bounds.size() - 1;
+
+    std::vector<std::size_t> tokens(chunks + 1, 0);
+    parallel_for(par, chunks, [&](const std::size_t k) {
+        tokens[k+1] = count_tokens(bounds[k], bounds[k+1]);
+    });
+    std::partial_sum(tokens.begin(), tokens.end(), tokens.begin());
+
+    const std::size_t decoded = tokens.back() / colors;
+    if(decoded > x * y)
+    {
+        throw std::runtime_error(std::string(func) + ": file " +
+            fname + " contains too many pixels: "_str +
+            std::to_string(x * y) + " pixels for "_str +
+            std::to_string(x)     + "x"_str            +
+            std::to_string(y)     + " image"_str);
+    }
+    img.resize(x, y);
+    if(img.size() == 0) {return;}
+
+    for(std::size_t k=1; k<chunks; ++k)
+    {
+        const std::size_t rest = (colors - tokens[k] % colors) % colors;
+        std::size_t n = rest;
+        bounds[k]  = skip_tokens(bounds[k], last, n);
+        tokens[k] += rest - n;
+    }
+
+    parallel_for(par, chunks, [&](const std::size_t k) {
+        memory_streambuf buf(bounds[k], static_cast<std::size_t>(bounds[k+1] - bounds[k]));
+        std::istream is(&buf);
+        ascii_tokenizer tokenizer(is, func, fname);
+
+        std::size_t row = (tokens[k] / colors) / x;
+        std::size_t col = (tokens[k] / colors) % x;
+        std::size_t v[colors];
+        while(true)
+        {
+            std::size_t c = 0;
+            while(c < colors && tokenizer.next(v[c])) {++c;}
+            if(c != colors) {break;} // a trailing partial pixel is ignored
+
+            store_decoded(img.row_ptr(row)[col], make(v), is_same_pixel{});
+            if(++col == x) {col = 0; ++row;}
+        }
+    });
+
+    // missing pixels are filled with the default value
+    for(std::size_t i=decoded; i<x*y; ++i)
+    {
+        store_decoded(img.row_ptr(i / x)[i % x], Native(), is_same_pixel{});
+    }
+    return;
+}
+
+// ascii files smaller than a chunk per thread are decoded on the calling thread.
+template<typename Image>
+void decode_ascii_parallel(std::istream& is, const header& hdr,
+        const std::string& fname, Image& img, const parallel_policy& par,
+        const char* func)
+{
+    using sample_type = sample_type_for<typename Image::pixel_type>;
+    using gray_type = basic_pixel<sample_type, 1>;
+    using  rgb_type = basic_pixel<sample_type, 3>;
+
+    const std::streampos pos = is.tellg();
+    is.seekg(0, std::ios::end);
+    const std::size_t size = static_cast<std::size_t>(is.tellg() - pos);
+    is.seekg(pos);
+
+    const std::size_t max_chunks = std::min(thread_count(par),
+            std::max<std::size_t>(1, size / binary_chunk_size));
+    if(max_chunks <= 1)
+    {
+        decode_as(is, hdr, fname, img, func);
+        return;
+    }
+    std::vector<char> payload(size);
+    is.read(payload.data(), static_cast<std::streamsize>(size));
+    payload.resize(static_cast<std::size_t>(is.gcount()));
+
+    const basic_gain_table<sample_type> gain(hdr.maxval);
+    switch(hdr.magic)
+    {
+        case '1':
+        {
+            decode_ascii_parallel<bit_pixel>(payload, hdr, fname, img, par, max_chunks,
+                [](const std::size_t* v) noexcept {return bit_pixel(v[0] != 0);},
+                "pnm::read_pbm_ascii");
+            break;
+        }
+        case '2':
+        {
+            decode_ascii_parallel<gray_type>(payload, hdr, fname, img, par, max_chunks,
+                [&gain](const std::size_t* v) noexcept {return gray_type(gain(v[0]));},
+                "pnm::read_pgm_ascii");
+            break;
+        }
+        default: // '3'
+        {
+            decode_ascii_parallel<rgb_type>(payload, hdr, fname, img, par, max_chunks,
+                [&gain](const std::size_t* v) noexcept {
+                    return rgb_type(gain(v[0]), gain(v[1]), gain(v[2]));
+                }, "pnm::read_ppm_ascii");
+            break;
+        }
+    }
+    return;
+}
+
+// decodes the payload that follows `hdr` in `ifs` on multiple threads. small
+// files are decoded on the calling thread.
+template<typename Image>
+void decode_parallel(std::ifstream& ifs, const header& hdr,
+        const std::string& fname, Image& img, const parallel_policy& par,
+        const char* func)
+{
+    using namespace detail::literals;
+    const std::size_t row   = bytes_per_row(hdr);
+    const std::size_t y     = hdr.height;
+    const std::size_t total = row * y;
+
+    const std::size_t max_bands = std::min(std::min(thread_count(par), y),
+            std::max<std::size_t>(1, total / binary_chunk_size));
+    if(hdr.magic == '1' || hdr.magic == '2' || hdr.magic == '3')
+    {
+        decode_ascii_parallel(ifs, hdr, fname, img, par, func);
+        return;
+    }
+    if(row == 0 || max_bands <= 1)
+    {
+        decode_as(ifs, hdr, fname, img, func);
+        return;
+    }
+    const std::size_t rows  = (y + max_bands - 1) / max_bands;
+    const std::size_t bands = (y + rows - 1) / rows;
+
+#ifdef PNM_HAS_POSIX_MMAP
+    ifs.close();
+    const int fd = ::open(fname.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw std::runtime_error(std::string(func) + ": file open error: " + fname);
+    }
+    struct closer
+    {
+        int fd;
+        ~closer() noexcept {::close(fd);}
+    } guard{fd};
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0)
+    {
+        throw std::runtime_error(std::string(func) + ": fstat failed: " + fname);
+    }
+    const std::size_t file_size = static_cast<std::size_t>(st.st_size);
+#else
+    ifs.seekg(0, std::ios::end);
+    const std::size_t file_size = static_cast<std::size_t>(ifs.tellg());
+#endif
+    if(file_size < hdr.offset + total)
+    {
+        const std::size_t found = (file_size < hdr.offset) ? 0 : file_size - hdr.offset;
+        throw std::runtime_error(std::string(func) + ": file " + fname +
+            " is truncated: expected "_str + std::to_string(total) +
+            " bytes of pixels, but only "_str + std::to_string(found) +
+            " bytes are found"_str);
+    }
+
+    // pfm stores the rows from bottom to top
+    const bool bottom_up = (hdr.magic == 'f' || hdr.magic == 'F');
+    img.resize(hdr.width, y);
+    parallel_for(par, bands, [&](const std::size_t i) {
+        const std::size_t first = i * rows;
+        header band = hdr;
+        band.height = std::min(rows, y - first);
+
+        image_band<Image> dst(img, bottom_up ? y - first - band.height : first,
+                              band.height);
+        const std::size_t offset = hdr.offset + first * row;
+#ifdef PNM_HAS_POSIX_MMAP
+        pread_streambuf buf(fd, offset, band.height * row);
+        std::istream is(&buf);
+#else
+        std::ifstream is(fname, std::ios::binary);
+        is.seekg(static_cast<std::streamoff>(offset));
+#endif
+        decode_as(is, band, fname, dst, func);
+    });
+    return;
+}
+
+template<typename Image>
+header read_into_parallel(const std::string& fname, Image& img,
+                          const parallel_policy& par, const char* func)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(std::string(func) + ": file open error: " + fname);
+    }
+    const header hdr = read_header(ifs, func, fname);
+    decode_parallel(ifs, hdr, fname, img, par, func);
+    return hdr;
+}
+
+template<typename Pixel, typename Alloc>
+image<Pixel, Alloc> read_parallel(const std::string& fname,
+        const char magic, const char* kind, const parallel_policy& par,
+        const char* func)
+{
+    std::ifstream ifs(fname, std::ios::binary);
+    if(!ifs.good())
+    {
+        throw std::runtime_error(std::string(func) + ": file open error: " + fname);
+    }
+    const header hdr = expect_header(ifs, magic, func, kind, fname);
+    image<Pixel, Alloc> img;
+    decode_parallel(ifs, hdr, fname, img, par, func);
+    return img;
+}
+} // detail
+
+template<typename Pixel = rgb_pixel, typename Alloc = std::allocator<Pixel>>
+image<Pixel, Alloc> read(const std::string& fname, const parallel_policy& par)
+{
+    image<Pixel, Alloc> img;
+    detail::read_into_parallel(fname, img, par, "pnm::read");
+    return img;
+}
+template<typename Pixel, typename Alloc>
+header read_into(const std::string& fname, image<Pixel, Alloc>& img,
+                 const parallel_policy& par)
+{
+    return detail::read_into_parallel(fname, img, par, "pnm::read_into");
+}
+template<typename Pixel, std::size_t Alignment>
+header read_into(const std::string& fname, aligned_image<Pixel, Alignment>& img,
+                 const parallel_policy& par)
+{
+    return detail::read_into_parallel(fname, img, par, "pnm::read_into");
+}
+
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm_ascii(const std::string& fname,
+                                       const parallel_policy& par)
+{
+    return detail::read_parallel<bit_pixel, Alloc>(
+            fname, '1', "pbm", par, "pnm::read_pbm_ascii");
+}
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm_ascii(const std::string& fname,
+                                        const parallel_policy& par)
+{
+    return detail::read_parallel<gray_pixel, Alloc>(
+            fname, '2', "pgm", par, "pnm::read_pgm_ascii");
+}
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm_ascii(const std::string& fname,
+                                       const parallel_policy& par)
+{
+    return detail::read_parallel<rgb_pixel, Alloc>(
+            fname, '3', "ppm", par, "pnm::read_ppm_ascii");
+}
+
+template<typename Alloc = std::allocator<bit_pixel>>
+image<bit_pixel, Alloc> read_pbm_binary(const std::string& fname,
+                                        const parallel_policy& par)
+{
+    return detail::read_parallel<bit_pixel, Alloc>(
+            fname, '4', "pbm", par, "pnm::read_pbm_binary");
+}
+template<typename Alloc = std::allocator<gray_pixel>>
+image<gray_pixel, Alloc> read_pgm_binary(const std::string& fname,
+                                         const parallel_policy& par)
+{
+    return detail::read_parallel<gray_pixel, Alloc>(
+            fname, '5', "pgm", par, "pnm::read_pgm_binary");
+}
+template<typename Alloc = std::allocator<rgb_pixel>>
+image<rgb_pixel, Alloc> read_ppm_binary(const std::string& fname,
+                                        const parallel_policy& par)
+{
+    return detail::read_parallel<rgb_pixel, Alloc>(
+            fname, '6', "ppm", par, "pnm::read_ppm_binary");
+}
+
+// --------------------------------------------------------------------------
+//                             * pnm::scanline_reader
+//  ___  ___ __ _ _ __           - reads pbm, pgm, ppm line by line
+// / __|/ __/ _` | '_ \          - keeps only O(width) memory
+// \__ \ (_| (_| | | | |
+// |___/\___\__,_|_| |_|
+// --------------------------------------------------------------------------
+
+class scanline_reader
+{
+  public:
+
+    explicit scanline_reader(const std::string& fname)
+        : fname_(fname), ifs_(fname, std::ios::binary),
+          tokens_(ifs_, "pnm::scanline_reader", fname),
+          magic_('\0'), nx_(0), ny_(0), max_(0), iy_(0)
+    {
+        if(!ifs_.good())
+        {
+            throw std::runtime_error(
+                    "pnm::scanline_reader: file open error: " + fname);
+        }
+        const header hdr = detail::read_header(ifs_, "pnm::scanline_reader", fname);
+        if(hdr.magic < '1' || '6' < hdr.magic)
+        {
+            throw std::runtime_error("pnm::scanline_reader: file " + fname +
+                " is not any of pbm, pgm, or ppm: magic number is P" + hdr.magic);
+        }
+        this->magic_ = hdr.magic;
+        this->nx_    = hdr.width;
+        this->ny_    = hdr.height;
+        this->max_   = hdr.maxval;
+        const bool is_pbm = (magic_ == '1' || magic_ == '4');
+        if(!is_pbm) {this->gain_ = detail::gain_table(max_);}
+    }
+    ~scanline_reader() = default;
+
+    scanline_reader(const scanline_reader&) = delete;
+    scanline_reader& operator=(const scanline_reader&) = delete;
+
+    // '1' to '6'
+    char        magic()  const noexcept {return magic_;}
+    format      fmt()    const noexcept
+    {return ('4' <= magic_) ? format::binary : format::ascii;}
+    std::size_t width()  const noexcept {return nx_;}
+    std::size_t height() const noexcept {return ny_;}
+    std::size_t maxval() const noexcept {return max_;}
+
+    // the number of lines that are already read
+    std::size_t lines_read() const noexcept {return iy_;}
+    bool        eof()        const noexcept {return iy_ == ny_;}
+
+    // writes `width()` pixels to `dst`. returns false if all lines are read.
+    // if `Pixel` differs from the pixel type in the file, converts it in the
+    // same way as `convert_to`.
+    template<typename Pixel>
+    bool read_line(Pixel* dst)
+    {
+        if(this->eof()) {return false;}
+        switch(magic_)
+        {
+            case '1': case '4': {this->read_line_as<bit_pixel >(dst); break;}
+            case '2': case '5': {this->read_line_as<gray_pixel>(dst); break;}
+            case '3': case '6': {this->read_line_as< rgb_pixel>(dst); break;}
+            default: break;
+        }
+        this->iy_ += 1;
+        return true;
+    }
+    template<typename Pixel>
+    bool read_line(std::vector<Pixel>& dst)
+    {
+        dst.resize(nx_);
+        return this->read_line(dst.data());
+    }
+
+    // reads at most `n` lines into a contiguous buffer. returns number of
+    // lines that are read.
+    template<typename Pixel>
+    std::size_t read_lines(Pixel* dst, const std::size_t n)
+    {
+        std::size_t i = 0;
+        while(i < n && this->read_line(dst + i * nx_)) {++i;}
+        return i;
+    }
+    // reads at most `view.height()` lines into the view.
+    template<typename T>
+    std::size_t read_lines(const basic_image_view<T>& view)
+    {
+        static_assert(!std::is_const<T>::value,
+                      "pnm::scanline_reader: cannot write to const_image_view");
+        if(view.width() != nx_)
+        {
+            throw std::out_of_range("pnm::scanline_reader::read_lines: "
+                "width of the view (" + std::to_string(view.width()) +
+                ") differs from the file (" + std::to_string(nx_) + ")");
+        }
+        std::size_t i = 0;
+        while(i < view.height() && this->read_line(view.row_ptr(i))) {++i;}
+        return i;
+    }
+
+  private:
+
+    template<typename Native, typename Pixel>
+    void read_line_as(Pixel* dst)
+    {
+        this->read_line_as<Native>(dst, std::is_same<Native, Pixel>{});
+    }
+    template<typename Native, typename Pixel>
+    void read_line_as(Pixel* dst, std::true_type)
+    {
+        this->decode_line(dst);
+    }
+    template<typename Native, typename Pixel>
+    void read_line_as(Pixel* dst, std::false_type)
+    {
+        std::vector<Native>& buf = this->native_buffer(Native{});
+        buf.resize(nx_);
+        this->decode_line(buf.data());
+        std::transform(buf.begin(), buf.end(), dst, [](const Native& p) {
+                return detail::convert_impl<Native, Pixel>::invoke(p);
+            });
+    }
+
+    std::vector< bit_pixel>& native_buffer( bit_pixel) noexcept {return bits_;}
+    std::vector<gray_pixel>& native_buffer(gray_pixel) noexcept {return grays_;}
+    std::vector< rgb_pixel>& native_buffer( rgb_pixel) noexcept {return rgbs_;}
+
+    void decode_line(bit_pixel* dst)
+    {
+        if(magic_ == '4')
+        {
+            const std::size_t bytes_per_line = (nx_ + 7) / 8;
+            bytes_.resize(bytes_per_line);
+            detail::read_payload(ifs_, reinterpret_cast<char*>(bytes_.data()),
+                    bytes_per_line, "pnm::scanline_reader", fname_);
+            detail::unpack_bits(bytes_.data(), dst, nx_);
+            return;
+        }
+        for(std::size_t i=0; i<nx_; ++i)
+        {
+            dst[i] = bit_pixel(this->next_ascii_value() != 0);
+        }
+        return;
+    }
+    void decode_line(gray_pixel* dst)
+    {
+        this->decode_samples(reinterpret_cast<std::uint8_t*>(dst), nx_);
+    }
+    void decode_line(rgb_pixel* dst)
+    {
+        this->decode_samples(reinterpret_cast<std::uint8_t*>(dst), nx_ * 3);
+    }
+
+    void decode_samples(std::uint8_t* dst, const std::size_t n)
+    {
+        if(magic_ == '5' || magic_ == '6')
+        {
+            detail::read_samples(ifs_, dst, n, max_, gain_,
+                                 "pnm::scanline_reader", fname_);
+            return;
+        }
+        for(std::size_t i=0; i<n; ++i)
+        {
+            dst[i] = gain_(this->next_ascii_value());
+        }
+        return;
+    }
+
+    std::size_t next_ascii_value()
+    {
+        std::size_t value = 0;
+        if(!tokens_.next(value))
+        {
+            throw std::runtime_error("pnm::scanline_reader: file " + fname_ +
+                " does not contain enough pixels for " + std::to_string(nx_) +
+                "x" + std::to_string(ny_) + " image");
+        }
+        return value;
+    }
+
+  private:
+    std::string   fname_;
+    std::ifstream ifs_;
+    detail::ascii_tokenizer tokens_;
+    char          magic_;
+    std::size_t   nx_, ny_, max_;
+    std::size_t   iy_;
+    detail::gain_table gain_;
+    std::vector<std::uint8_t> bytes_;
+    std::vector< bit_pixel>   bits_;
+    std::vector<gray_pixel>   grays_;
+    std::vector< rgb_pixel>   rgbs_;
+};
+
+// --------------------------------------------------------------------------
+//                             * pnm::mapped_image
+//  _ __ ___   __ _ _ __         - read-only view of a binary pgm/ppm file
+// | '_ ` _ \ / _` | '_ \          mapped onto memory
+// | | | | | | (_| | |_) )     * enum class access_pattern
+// |_| |_| |_|\__,_| .__/        - hint for madvise
+//                 |_|         * map_pgm, map_ppm
+// --------------------------------------------------------------------------
+
+enum class access_pattern {normal, sequential, random, willneed};
+
+template<typename Pixel>
+class mapped_image
+{
+    static_assert(std::is_same<Pixel, gray_pixel>::value ||
+                  std::is_same<Pixel,  rgb_pixel>::value,
+                  "pnm::mapped_image supports only gray_pixel and rgb_pixel");
+  public:
+    using pixel_type      = Pixel;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using value_type      = pixel_type;
+    using pointer         = pixel_type const*;
+    using const_pointer   = pixel_type const*;
+    using reference       = pixel_type const&;
+    using const_reference = pixel_type const&;
+    using iterator        = pixel_type const*;
+    using const_iterator  = pixel_type const*;
+
+    using line_proxy          = detail::pointer_line_proxy<const pixel_type>;
+    using const_line_proxy    = line_proxy;
+    using line_proxy_iterator = detail::pointer_line_proxy_iterator<const pixel_type>;
+    using const_line_proxy_iterator = line_proxy_iterator;
+    using line_range          = detail::range<line_proxy_iterator>;
+    using const_line_range    = line_range;
+
+    mapped_image(const std::string& fname,
+                 const access_pattern pattern = access_pattern::normal)
+        : nx_(0), ny_(0), pixels_(nullptr), addr_(nullptr), length_(0)
+    {
+        using namespace detail::literals;
+        const char magic = std::is_same<Pixel, gray_pixel>::value ? '5' : '6';
+
+        std::ifstream ifs(fname, std::ios::binary);
+        if(!ifs.good())
+        {
+            throw std::runtime_error(
+                    "pnm::mapped_image: file open error: " + fname);
+        }
+        const header hdr = detail::read_header(ifs, "pnm::mapped_image", fname);
+        if(hdr.magic != magic)
+        {
+            throw std::runtime_error("pnm::mapped_image: " + fname +
+                " is not a binary "_str + (magic == '5' ? "pgm" : "ppm") +
+                " file: magic number is P"_str + hdr.magic);
+        }
+        const std::size_t x = hdr.width, y = hdr.height, max = hdr.maxval;
+
+        if(max != 255)
+        {
+            throw std::runtime_error("pnm::mapped_image: file " + fname +
+                " has maxval "_str + std::to_string(max) +
+                ". only 255 can be mapped without conversion"_str);
+        }
+        const std::size_t first = hdr.offset;
+        const std::size_t bytes = x * y * sizeof(pixel_type);
+
+#ifdef PNM_HAS_POSIX_MMAP
+        ifs.close();
+        const int fd = ::open(fname.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            throw std::runtime_error(
+                    "pnm::mapped_image: file open error: " + fname);
+        }
+        struct stat st;
+        if(::fstat(fd, &st) != 0 ||
+           static_cast<std::size_t>(st.st_size) < first + bytes)
+        {
+            ::close(fd);
+            throw std::runtime_error("pnm::mapped_image: file " + fname +
+                " is truncated: expected "_str + std::to_string(bytes) +
+                " bytes of pixels"_str);
+        }
+        this->length_ = static_cast<std::size_t>(st.st_size);
+        void* addr = ::mmap(nullptr, this->length_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping is kept after closing fd
+        if(addr == MAP_FAILED)
+        {
+            throw std::runtime_error("pnm::mapped_image: mmap failed: " + fname);
+        }
+        this->addr_   = addr;
+        this->pixels_ = reinterpret_cast<const pixel_type*>(
+                static_cast<const char*>(addr) + first);
+        this->advise(pattern);
+#else
+        (void)pattern;
+        this->buffer_.resize(x * y);
+        if(bytes != 0)
+        {
+            detail::read_payload(ifs, reinterpret_cast<char*>(buffer_.data()),
+                                 bytes, "pnm::mapped_image", fname);
+        }
+        this->pixels_ = buffer_.data();
+#endif
+        this->nx_ = x;
+        this->ny_ = y;
+    }
+
+    ~mapped_image() noexcept {this->release();}
+
+    mapped_image(const mapped_image&) = delete;
+    mapped_image& operator=(const mapped_image&) = delete;
+
+    mapped_image(mapped_image&& other) noexcept
+        : nx_(other.nx_), ny_(other.ny_), pixels_(other.pixels_),
+          addr_(other.addr_), length_(other.length_)
+#ifndef PNM_HAS_POSIX_MMAP
+          , buffer_(std::move(other.buffer_))
+#endif
+    {
+        other.nx_ = 0; other.ny_ = 0; other.pixels_ = nullptr;
+        other.addr_ = nullptr; other.length_ = 0;
+    }
+    mapped_image& operator=(mapped_image&& other) noexcept
+    {
+        if(this == std::addressof(other)) {return *this;}
+        this->release();
+        this->nx_     = other.nx_;     other.nx_     = 0;
+        this->ny_     = other.ny_;     other.ny_     = 0;
+        this->pixels_ = other.pixels_; other.pixels_ = nullptr;
+        this->addr_   = other.addr_;   other.addr_   = nullptr;
+        this->length_ = other.length_; other.length_ = 0;
+#ifndef PNM_HAS_POSIX_MMAP
+        this->buffer_ = std::move(other.buffer_);
+#endif
+        return *this;
+    }
+
+    // tells the kernel how the pixels will be accessed. it is just a hint and
+    // it does nothing if mmap is not available.
+    void advise(const access_pattern pattern) const noexcept
+    {
+#ifdef PNM_HAS_POSIX_MMAP
+        if(this->addr_ == nullptr) {return;}
+        int advice = MADV_NORMAL;
+        switch(pattern)
+        {
+            case access_pattern::normal    : {advice = MADV_NORMAL;     break;}
+            case access_pattern::sequential: {advice = MADV_SEQUENTIAL; break;}
+            case access_pattern::random    : {advice = MADV_RANDOM;     break;}
+            case access_pattern::willneed  : {advice = MADV_WILLNEED;   break;}
+        }
+        ::madvise(this->addr_, this->length_, advice);
+#else
+        (void)pattern;
+#endif
+        return;
+    }
+
+    line_proxy operator[](const std::size_t i) const noexcept
+    {
+        return line_proxy(pixels_ + i * nx_, i, nx_);
+    }
+    line_proxy at(const std::size_t i) const
+    {
+        if(this->ny_ <= i)
+        {
+            throw std::out_of_range("pnm::mapped_image::at index(" +
+                std::to_string(i) + std::string(") exceeds height (") +
+                std::to_string(this->ny_) + std::string(")"));
+        }
+        return (*this)[i];
+    }
+
+    const_reference
+    operator()(const std::size_t ix, const std::size_t iy) const noexcept
+    {
+        return pixels_[ix + iy * nx_];
+    }
+    const_reference at(const std::size_t ix, const std::size_t iy) const
+    {
+        if(this->nx_ <= ix || this->ny_ <= iy)
+        {
+            throw std::out_of_range("pnm::mapped_image::at index(" +
+                std::to_string(ix) + std::string(", ") + std::to_string(iy) +
+                std::string(") exceeds image size"));
+        }
+        return pixels_[ix + iy * nx_];
+    }
+
+    const_reference raw_access(const std::size_t i) const noexcept {return pixels_[i];}
+    const_reference raw_at(const std::size_t i) const
+    {
+        if(this->size() <= i)
+        {
+            throw std::out_of_range("pnm::mapped_image::raw_at index(" +
+                std::to_string(i) + std::string(") exceeds size (") +
+                std::to_string(this->size()) + std::string(")"));
+        }
+        return pixels_[i];
+    }
+
+    const_pointer data() const noexcept {return pixels_;}
+
+    std::size_t width()  const noexcept {return nx_;}
+    std::size_t height() const noexcept {return ny_;}
+    std::size_t x_size() const noexcept {return nx_;}
+    std::size_t y_size() const noexcept {return ny_;}
+
+    std::size_t size() const noexcept {return nx_ * ny_;}
+
+    const_iterator begin()  const noexcept {return pixels_;}
+    const_iterator end()    const noexcept {return pixels_ + this->size();}
+    const_iterator cbegin() const noexcept {return pixels_;}
+    const_iterator cend()   const noexcept {return pixels_ + this->size();}
+
+    line_proxy_iterator line_begin()  const noexcept
+    {return line_proxy_iterator(pixels_, nx_, 0, nx_);}
+    line_proxy_iterator line_end()    const noexcept
+    {return line_proxy_iterator(pixels_, nx_, ny_, nx_);}
+    line_proxy_iterator line_cbegin() const noexcept
+    {return line_proxy_iterator(pixels_, nx_, 0, nx_);}
+    line_proxy_iterator line_cend()   const noexcept
+    {return line_proxy_iterator(pixels_, nx_, ny_, nx_);}
+
+    line_range lines() const noexcept
+    {return line_range(this->line_begin(), this->line_end());}
+
+  private:
+
+    void release() noexcept
+    {
+#ifdef PNM_HAS_POSIX_MMAP
+        if(this->addr_ != nullptr)
+        {
+            ::munmap(this->addr_, this->length_);
+        }
+#endif
+        this->addr_   = nullptr;
+        this->length_ = 0;
+        return;
+    }
+
+  private:
+    std::size_t       nx_, ny_;
+    const pixel_type* pixels_;
+    void*             addr_;
+    std::size_t       length_;
+#ifndef PNM_HAS_POSIX_MMAP
+    std::vector<pixel_type> buffer_;
+#endif
+};
+
+inline mapped_image<gray_pixel>
+map_pgm(const std::string& fname,
+        const access_pattern pattern = access_pattern::normal)
+{
+    return mapped_image<gray_pixel>(fname, pattern);
+}
+inline mapped_image<rgb_pixel>
+map_ppm(const std::string& fname,
+        const access_pattern pattern = access_pattern::normal)
+{
+    return mapped_image<rgb_pixel>(fname, pattern);
+}
+
+// --------------------------------------------------------------------------
+//                  _ _          * write_(pbm|pgm|ppm)_(ascii|binary)
+//  __      __ _ __(_) |_  ___     - the most specific ones
+//  \ \ /\ / /| '_/| | __|/ _ \  * write_(pbm|pgm|ppm)
+//   \ v  v / | |  | | |_(  __/    - requires format specifier
+//    \_/\_/  |_|  |_|\__|\___|  * write()
+//                                 - format is determined by pixel type
+// --------------------------------------------------------------------------
+
+namespace detail
+{
+// "  0 ", "  1 ", ..., "255 ". a value written by `setw(3)` followed by a space.
+inline const char* ascii_table() noexcept
+{
+    struct table_type
+    {
+        table_type() noexcept
+        {
+            for(std::size_t i=0; i<256; ++i)
+            {
+                chars[i*4+0] = (i < 100) ? ' ' : static_cast<char>('0' + i / 100);
+                chars[i*4+1] = (i <  10) ? ' ' : static_cast<char>('0' + i / 10 % 10);
+                chars[i*4+2] = static_cast<char>('0' + i % 10);
+                chars[i*4+3] = ' ';
+            }
+        }
+        char chars[256 * 4];
+    };
+    static const table_type table;
+    return table.chars;
+}
+
+// encoders for one line. they append the ascii representation of a line,
+// including the newline, to `buf`.
+inline void encode_line_ascii(const bit_pixel* line, const std::size_t nx,
+                              std::vector<char>& buf)
+{
+    const std::size_t offset = buf.size();
+    buf.resize(offset + std::max<std::size_t>(nx * 2, 1));
+    char* dst = buf.data() + offset;
+    for(std::size_t i=0; i<nx; ++i)
+    {
+        dst[i*2+0] = line[i].value ? '1' : '0';
+        dst[i*2+1] = ' ';
+    }
+    buf.back() = '\n';
+    return;
+}
+inline void encode_line_ascii(const gray_pixel* line, const std::size_t nx,
+                              std::vector<char>& buf)
+{
+    const char* const table = ascii_table();
+    const std::size_t offset = buf.size();
+    buf.resize(offset + std::max<std::size_t>(nx * 4, 1));
+    char* dst = buf.data() + offset;
+    for(std::size_t i=0; i<nx; ++i)
+    {
+        std::memcpy(dst + i*4, table + line[i].value * 4, 4);
+    }
+    buf.back() = '\n';
+    return;
+}
+inline void encode_line_ascii(const rgb_pixel* line, const std::size_t nx,
+                              std::vector<char>& buf)
+{
+    const char* const table = ascii_table();
+    const std::size_t offset = buf.size();
+    buf.resize(offset + std::max<std::size_t>(nx * 12, 1));
+    char* dst = buf.data() + offset;
+    for(std::size_t i=0; i<nx; ++i)
+    {
+        std::memcpy(dst + i*12 + 0, table + line[i].red   * 4, 4);
+        std::memcpy(dst + i*12 + 4, table + line[i].green * 4, 4);
+        std::memcpy(dst + i*12 + 8, table + line[i].blue  * 4, 4);
+    }
+    buf.back() = '\n';
+    return;
+}
+
+// writes a 16-bit value right-aligned in 5 characters followed by a space.
+inline void encode_sample16(char* dst, std::uint16_t v) noexcept
+{
+    dst[5] = ' ';
+    int i = 4;
+    do
+    {
+        dst[i--] = static_cast<char>('0' + v % 10);
+        v = static_cast<std::uint16_t>(v / 10);
+    }
+    while(v != 0);
+    while(i >= 0) {dst[i--] = ' ';}
+    return;
+}
+inline void encode_line_ascii(const gray16_pixel* line, const std::size_t nx,
+                              std::vector<char>& buf)
+{
+    const std::size_t offset = buf.size();
+    buf.resize(offset + std::max<std::size_t>(nx * 6, 1));
+    char* dst = buf.data() + offset;
+    for(std::size_t i=0; i<nx; ++i)
+    {
+        encode_sample16(dst + i*6, line[i].value);
+    }
+    buf.back() = '\n';
+    return;
+}
+inline void encode_line_ascii(const rgb16_pixel* line, const std::size_t nx,
+                              std::vector<char>& buf)
+{
+    const std::size_t offset = buf.size();
+    buf.resize(offset + std::max<std::size_t>(nx * 18, 1));
+    char* dst = buf.data() + offset;
+    for(std::size_t i=0; i<nx; ++i)
+    {
+        encode_sample16(dst + i*18 +  0, line[i].red);
+        encode_sample16(dst + i*18 +  6, line[i].green);
+        encode_sample16(dst + i*18 + 12, line[i].blue);
+    }
+    buf.back() = '\n';
+    return;
+}
+
+template<typename Pixel>
+inline void write_line_ascii(std::ostream& os, const Pixel* line,
+                             const std::size_t nx, std::vector<char>& buf)
+{
+    buf.clear();
+    encode_line_ascii(line, nx, buf);
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    return;
+}
+
+// encodes lines into a buffer and writes them in blocks.
+template<typename Pixel>
+void write_lines_ascii(std::ostream& os, const const_image_view<Pixel>& img)
+{
+    std::vector<char> buf;
+    buf.reserve(binary_chunk_size * 2);
+    for(std::size_t j=0; j<img.height(); ++j)
+    {
+        encode_line_ascii(img.row_ptr(j), img.width(), buf);
+        if(buf.size() >= binary_chunk_size)
+        {
+            os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+            buf.clear();
+        }
+    }
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    return;
+}
+
+inline void write_line_binary(std::ostream& os, const bit_pixel* line,
+                              const std::size_t nx, std::vector<char>& buf)
+{
+    buf.resize((nx + 7) / 8);
+    pack_bits(line, reinterpret_cast<std::uint8_t*>(buf.data()), nx);
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    return;
+}
+inline void write_line_binary(std::ostream& os, const gray_pixel* line,
+                              const std::size_t nx, std::vector<char>&)
+{
+    os.write(reinterpret_cast<const char*>(line),
+             static_cast<std::streamsize>(nx));
+    return;
+}
+inline void write_line_binary(std::ostream& os, const rgb_pixel* line,
+                              const std::size_t nx, std::vector<char>&)
+{
+    os.write(reinterpret_cast<const char*>(line),
+             static_cast<std::streamsize>(nx * 3));
+    return;
+}
+
+// writes all the lines in a view. pixels with 8-bit samples are stored as
+// they are written, so contiguous storage is dumped at once. pbm rows are
+// packed into a staging buffer first.
+template<typename Pixel>
+void write_lines_binary(std::ostream& os, const const_image_view<Pixel>& img)
+{
+    static_assert(std::is_same<typename Pixel::value_type, std::uint8_t>::value &&
+                  sizeof(Pixel) == Pixel::colors,
+                  "pixels must be stored in the same layout as the file");
+
+    if(img.is_contiguous())
+    {
+        os.write(reinterpret_cast<const char*>(img.row_ptr(0)),
+                 static_cast<std::streamsize>(img.size() * sizeof(Pixel)));
+        return;
+    }
+    for(std::size_t j=0; j<img.height(); ++j)
+    {
+        os.write(reinterpret_cast<const char*>(img.row_ptr(j)),
+                 static_cast<std::streamsize>(img.width() * sizeof(Pixel)));
+    }
+    return;
+}
+inline void write_lines_binary(std::ostream& os,
+                               const const_image_view<bit_pixel>& img)
+{
+    const std::size_t bytes_per_line = (img.width() + 7) / 8;
+    const std::size_t nlines = std::min(img.height(),
+                                        lines_per_chunk(bytes_per_line));
+    std::vector<char> buf(bytes_per_line * nlines);
+    for(std::size_t j=0; j<img.height(); j+=nlines)
+    {
+        const std::size_t n = std::min(nlines, img.height() - j);
+        for(std::size_t k=0; k<n; ++k)
+        {
+            pack_bits(img.row_ptr(j+k), reinterpret_cast<std::uint8_t*>(
+                      buf.data() + k * bytes_per_line), img.width());
+        }
+        os.write(buf.data(), static_cast<std::streamsize>(n * bytes_per_line));
+    }
+    return;
+}
+
+// 16-bit samples are converted to big endian in a staging buffer.
+template<typename Pixel>
+void write_lines_binary16(std::ostream& os, const const_image_view<Pixel>& img)
+{
+    constexpr std::size_t colors = Pixel::colors;
+    const std::size_t chunk = binary_chunk_size / 2;
+    std::vector<std::uint16_t> buf;
+
+    const auto write_samples = [&](const std::uint16_t* src, const std::size_t n) {
+        for(std::size_t i=0; i<n; i+=chunk)
+        {
+            const std::size_t m = std::min(chunk, n - i);
+            buf.assign(src + i, src + i + m);
+            swap_bytes16(buf.data(), m);
+            os.write(reinterpret_cast<const char*>(buf.data()),
+                     static_cast<std::streamsize>(m * 2));
+        }
+    };
+    if(img.is_contiguous())
+    {
+        if(img.size() != 0)
+        {
+            write_samples(reinterpret_cast<const std::uint16_t*>(img.row_ptr(0)),
+                          img.size() * colors);
+        }
+        return;
+    }
+    for(std::size_t j=0; j<img.height(); ++j)
+    {
+        write_samples(reinterpret_cast<const std::uint16_t*>(img.row_ptr(j)),
+                      img.width() * colors);
+    }
+    return;
+}
+inline void write_lines_binary(std::ostream& os,
+                               const const_image_view<gray16_pixel>& img)
+{
+    return write_lines_binary16(os, img);
+}
+inline void write_lines_binary(std::ostream& os,
+                               const const_image_view<rgb16_pixel>& img)
+{
+    return write_lines_binary16(os, img);
+}
+inline void write_lines_binary(std::ostream& os,
+                               const const_image_view<gray_alpha16_pixel>& img)
+{
+    return write_lines_binary16(os, img);
+}
+inline void write_lines_binary(std::ostream& os,
+                               const const_image_view<rgba16_pixel>& img)
+{
+    return write_lines_binary16(os, img);
+}
+
+template<typename Pixel> struct pnm_magic;
+template<> struct pnm_magic< bit_pixel>
+{
+    static constexpr char ascii()  noexcept {return '1';}
+    static constexpr char binary() noexcept {return '4';}
+};
+template<> struct pnm_magic<gray_pixel>
+{
+    static constexpr char ascii()  noexcept {return '2';}
+    static constexpr char binary() noexcept {return '5';}
+};
+template<> struct pnm_magic< rgb_pixel>
+{
+    static constexpr char ascii()  noexcept {return '3';}
+    static constexpr char binary() noexcept {return '6';}
+};
+} // detail
+
+inline void write_pbm_ascii(const std::string& fname,
+                            const const_image_view<bit_pixel>& img)
+{
+    std::ofstream ofs(fname);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pbm_ascii: file open error: " + fname);
+    }
+
+    ofs << "P1\n" << img.x_size() << ' ' << img.y_size() << "\n";
+
+    detail::write_lines_ascii(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_pbm_ascii(const std::string& fname,
+                     const image<bit_pixel, Alloc>& img)
+{
+    return write_pbm_ascii(fname, const_image_view<bit_pixel>(img));
+}
+
+inline void write_pbm_binary(const std::string& fname,
+                             const const_image_view<bit_pixel>& img)
+{
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pbm_binary: file open error: " + fname);
+    }
+
+    ofs << "P4\n" << img.x_size() << ' ' << img.y_size() << "\n";
+
+    detail::write_lines_binary(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_pbm_binary(const std::string& fname,
+                      const image<bit_pixel, Alloc>& img)
+{
+    return write_pbm_binary(fname, const_image_view<bit_pixel>(img));
+}
+
+// packed_bit_image is already in the P4 layout.
+template<typename Alloc>
+void write_pbm_binary(const std::string& fname,
+                      const packed_bit_image<Alloc>& img)
+{
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pbm_binary: file open error: " + fname);
+    }
+
+    ofs << "P4\n" << img.x_size() << ' ' << img.y_size() << "\n";
+
+    ofs.write(reinterpret_cast<const char*>(img.data()),
+              static_cast<std::streamsize>(img.bytes()));
+    return ;
+}
+template<typename Alloc>
+void write_pbm_ascii(const std::string& fname,
+                     const packed_bit_image<Alloc>& img)
+{
+    std::ofstream ofs(fname);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pbm_ascii: file open error: " + fname);
+    }
+
+    ofs << "P1\n" << img.x_size() << ' ' << img.y_size() << "\n";
+
+    std::vector<bit_pixel> line(img.width());
+    std::vector<char> buf;
+    for(std::size_t j=0; j<img.height() && !line.empty(); ++j)
+    {
+        detail::unpack_bits(img.row_data(j), line.data(), img.width());
+        detail::write_line_ascii(ofs, line.data(), img.width(), buf);
+    }
+    return ;
+}
+
+inline void write_pbm(const std::string& fname,
+                      const const_image_view<bit_pixel>& img, const format fmt)
+{
+    if(fmt == format::ascii)
+    {
+        return write_pbm_ascii(fname, img);
+    }
+    else if(fmt == format::binary)
+    {
+        return write_pbm_binary(fname, img);
+    }
+    throw std::runtime_error("pnm::write_pbm: "
+            "invalid format flag (neither ascii nor binary)");
+}
+template<typename Alloc>
+void write_pbm(const std::string& fname, const image<bit_pixel, Alloc>& img,
+               const format fmt)
+{
+    return write_pbm(fname, const_image_view<bit_pixel>(img), fmt);
+}
+template<typename Alloc>
+void write_pbm(const std::string& fname, const packed_bit_image<Alloc>& img,
+               const format fmt)
+{
+    if(fmt == format::ascii)
+    {
+        return write_pbm_ascii(fname, img);
+    }
+    else if(fmt == format::binary)
+    {
+        return write_pbm_binary(fname, img);
+    }
+    throw std::runtime_error("pnm::write_pbm: "
+            "invalid format flag (neither ascii nor binary)");
+}
+
+inline void write_pgm_ascii(const std::string& fname,
+                            const const_image_view<gray_pixel>& img)
+{
+    std::ofstream ofs(fname);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pgm_ascii: file open error: " + fname);
+    }
+
+    ofs << "P2\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
+
+    detail::write_lines_ascii(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_pgm_ascii(const std::string& fname,
+                     const image<gray_pixel, Alloc>& img)
+{
+    return write_pgm_ascii(fname, const_image_view<gray_pixel>(img));
+}
+
+inline void write_pgm_binary(const std::string& fname,
+                             const const_image_view<gray_pixel>& img)
+{
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pgm_ascii: file open error: " + fname);
+    }
+
+    ofs << "P5\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
+
+    detail::write_lines_binary(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_pgm_binary(const std::string& fname,
+                      const image<gray_pixel, Alloc>& img)
+{
+    return write_pgm_binary(fname, const_image_view<gray_pixel>(img));
+}
+
+inline void write_pgm(const std::string& fname,
+                      const const_image_view<gray_pixel>& img, const format fmt)
+{
+    if(fmt == format::ascii)
+    {
+        return write_pgm_ascii(fname, img);
+    }
+    else if(fmt == format::binary)
+    {
+        return write_pgm_binary(fname, img);
+    }
+    throw std::runtime_error("pnm::write_pgm: "
+            "invalid format flag (neither ascii nor binary)");
+}
+template<typename Alloc>
+void write_pgm(const std::string& fname, const image<gray_pixel, Alloc>& img,
+               const format fmt)
+{
+    return write_pgm(fname, const_image_view<gray_pixel>(img), fmt);
+}
+
+
+inline void write_ppm_ascii(const std::string& fname,
+                            const const_image_view<rgb_pixel>& img)
+{
+    std::ofstream ofs(fname);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_ppm_ascii: file open error: " + fname);
+    }
+
+    ofs << "P3\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
+
+    detail::write_lines_ascii(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_ppm_ascii(const std::string& fname,
+                     const image<rgb_pixel, Alloc>& img)
+{
+    return write_ppm_ascii(fname, const_image_view<rgb_pixel>(img));
+}
+
+inline void write_ppm_binary(const std::string& fname,
+                             const const_image_view<rgb_pixel>& img)
+{
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_ppm_binary: file open error: " + fname);
+    }
+
+    ofs << "P6\n" << img.x_size() << ' ' << img.y_size() << "\n255\n";
+
+    detail::write_lines_binary(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_ppm_binary(const std::string& fname,
+                      const image<rgb_pixel, Alloc>& img)
+{
+    return write_ppm_binary(fname, const_image_view<rgb_pixel>(img));
+}
+
+inline void write_ppm(const std::string& fname,
+                      const const_image_view<rgb_pixel>& img, const format fmt)
+{
+    if(fmt == format::ascii)
+    {
+        return write_ppm_ascii(fname, img);
+    }
+    else if(fmt == format::binary)
+    {
+        return write_ppm_binary(fname, img);
+    }
+    throw std::runtime_error("pnm::write_ppm: "
+            "invalid format flag (neither ascii nor binary)");
+}
+template<typename Alloc>
+void write_ppm(const std::string& fname, const image<rgb_pixel, Alloc>& img,
+               const format fmt)
+{
+    return write_ppm(fname, const_image_view<rgb_pixel>(img), fmt);
+}
+
+inline void write_pgm_ascii(const std::string& fname,
+                            const const_image_view<gray16_pixel>& img)
+{
+    std::ofstream ofs(fname);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pgm_ascii: file open error: " + fname);
+    }
+
+    ofs << "P2\n" << img.x_size() << ' ' << img.y_size() << "\n65535\n";
+
+    detail::write_lines_ascii(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_pgm_ascii(const std::string& fname,
+                     const image<gray16_pixel, Alloc>& img)
+{
+    return write_pgm_ascii(fname, const_image_view<gray16_pixel>(img));
+}
+
+inline void write_pgm_binary(const std::string& fname,
+                             const const_image_view<gray16_pixel>& img)
+{
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_pgm_binary: file open error: " + fname);
+    }
+
+    ofs << "P5\n" << img.x_size() << ' ' << img.y_size() << "\n65535\n";
+
+    detail::write_lines_binary(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_pgm_binary(const std::string& fname,
+                      const image<gray16_pixel, Alloc>& img)
+{
+    return write_pgm_binary(fname, const_image_view<gray16_pixel>(img));
+}
+
+inline void write_pgm(const std::string& fname,
+                      const const_image_view<gray16_pixel>& img, const format fmt)
+{
+    if(fmt == format::ascii)
+    {
+        return write_pgm_ascii(fname, img);
+    }
+    else if(fmt == format::binary)
+    {
+        return write_pgm_binary(fname, img);
+    }
+    throw std::runtime_error("pnm::write_pgm: "
+            "invalid format flag (neither ascii nor binary)");
+}
+template<typename Alloc>
+void write_pgm(const std::string& fname, const image<gray16_pixel, Alloc>& img,
+               const format fmt)
+{
+    return write_pgm(fname, const_image_view<gray16_pixel>(img), fmt);
+}
+
+inline void write_ppm_ascii(const std::string& fname,
+                            const const_image_view<rgb16_pixel>& img)
+{
+    std::ofstream ofs(fname);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_ppm_ascii: file open error: " + fname);
+    }
+
+    ofs << "P3\n" << img.x_size() << ' ' << img.y_size() << "\n65535\n";
+
+    detail::write_lines_ascii(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_ppm_ascii(const std::string& fname,
+                     const image<rgb16_pixel, Alloc>& img)
+{
+    return write_ppm_ascii(fname, const_image_view<rgb16_pixel>(img));
+}
+
+inline void write_ppm_binary(const std::string& fname,
+                             const const_image_view<rgb16_pixel>& img)
+{
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(
+                "pnm::write_ppm_binary: file open error: " + fname);
+    }
+
+    ofs << "P6\n" << img.x_size() << ' ' << img.y_size() << "\n65535\n";
+
+    detail::write_lines_binary(ofs, img);
+    return ;
+}
+template<typename Alloc>
+void write_ppm_binary(const std::string& fname,
+                      const image<rgb16_pixel, Alloc>& img)
+{
+    return write_ppm_binary(fname, const_image_view<rgb16_pixel>(img));
+}
+
+inline void write_ppm(const std::string& fname,
+                      const const_image_view<rgb16_pixel>& img, const format fmt)
+{
+    if(fmt == format::ascii)
+    {
+        return write_ppm_ascii(fname, img);
+    }
+    else if(fmt == format::binary)
+    {
+        return write_ppm_binary(fname, img);
+    }
+    throw std::runtime_error("pnm::write_ppm: "
+            "invalid format flag (neither ascii nor binary)");
+}
+template<typename Alloc>
+void write_ppm(const std::string& fname, const image<rgb16_pixel, Alloc>& img,
+               const format fmt)
+{
+    return write_ppm(fname, const_image_view<rgb16_pixel>(img), fmt);
+}
+
+template<typename Alloc>
+inline void write(const std::string& fname, const image<bit_pixel, Alloc>& img,
+           const format fmt)
+{
+    return write_pbm(fname, img, fmt);
+}
+template<typename Alloc>
+inline void write(const std::string& fname, const image<gray_pixel, Alloc>& img,
+           const format fmt)
+{
+    return write_pgm(fname, img, fmt);
+}
+template<typename Alloc>
+inline void write(const std::string& fname, const image<rgb_pixel, Alloc>& img,
+           const format fmt)
+{
+    return write_ppm(fname, img, fmt);
+}
+
+inline void write(const std::string& fname,
+                  const const_image_view<bit_pixel>& img, const format fmt)
+{
+    return write_pbm(fname, img, fmt);
+}
+template<typename Alloc>
+inline void write(const std::string& fname, const packed_bit_image<Alloc>& img,
+                  const format fmt)
+{
+    return write_pbm(fname, img, fmt);
+}
+inline void write(const std::string& fname,
+                  const const_image_view<gray_pixel>& img, const format fmt)
+{
+    return write_pgm(fname, img, fmt);
+}
+inline void write(const std::string& fname,
+                  const const_image_view<rgb_pixel>& img, const format fmt)
+{
+    return write_ppm(fname, img, fmt);
+}
+
+template<typename Alloc>
+inline void write(const std::string& fname, const image<gray16_pixel, Alloc>& img,
+           const format fmt)
+{
+    return write_pgm(fname, img, fmt);
+}
+template<typename Alloc>
+inline void write(const std::string& fname, const image<rgb16_pixel, Alloc>& img,
+           const format fmt)
+{
+    return write_ppm(fname, img, fmt);
+}
+inline void write(const std::string& fname,
+                  const const_image_view<gray16_pixel>& img, const format fmt)
+{
+    return write_pgm(fname, img, fmt);
+}
+inline void write(const std::string& fname,
+                  const const_image_view<rgb16_pixel>& img, const format fmt)
+{
+    return write_ppm(fname, img, fmt);
+}
+
+// the padding of aligned_image is skipped.
+template<typename Pixel, std::size_t Alignment>
+inline void write(const std::string& fname,
+                  const aligned_image<Pixel, Alignment>& img, const format fmt)
+{
+    return write(fname, const_image_view<Pixel>(img), fmt);
+}
+
+// --------------------------------------------------------------------------
+// parallel binary writers. the size of a binary file is known from the width
+// and height, so the file is allocated first and each thread packs and writes
+// its own band of rows by pwrite. small images, and all images where POSIX
+// is not available, are written on the calling thread.
+
+namespace detail
+{
+inline std::string binary_header(const const_image_view<bit_pixel>& img)
+{
+    return "P4\n" + std::to_string(img.x_size()) + ' ' +
+           std::to_string(img.y_size()) + "\n";
+}
+inline std::string binary_header(const const_image_view<gray_pixel>& img)
+{
+    return "P5\n" + std::to_string(img.x_size()) + ' ' +
+           std::to_string(img.y_size()) + "\n255\n";
+}
+inline std::string binary_header(const const_image_view<rgb_pixel>& img)
+{
+    return "P6\n" + std::to_string(img.x_size()) + ' ' +
+           std::to_string(img.y_size()) + "\n255\n";
+}
+inline std::string binary_header(const const_image_view<gray16_pixel>& img)
+{
+    return "P5\n" + std::to_string(img.x_size()) + ' ' +
+           std::to_string(img.y_size()) + "\n65535\n";
+}
+inline std::string binary_header(const const_image_view<rgb16_pixel>& img)
+{
+    return "P6\n" + std::to_string(img.x_size()) + ' ' +
+           std::to_string(img.y_size()) + "\n65535\n";
+}
+
+template<typename Pixel>
+std::size_t binary_bytes_per_row(const const_image_view<Pixel>& img) noexcept
+{
+    return img.width() * sizeof(Pixel);
+}
+inline std::size_t binary_bytes_per_row(const const_image_view<bit_pixel>& img) noexcept
+{
+    return (img.width() + 7) / 8;
+}
+
+template<typename Pixel>
+void write_binary_parallel(const std::string& fname,
+        const const_image_view<Pixel>& img, const parallel_policy& par,
+        const char* func)
+{
+    const std::string hdr = binary_header(img);
+#ifdef PNM_HAS_POSIX_MMAP
+    const std::size_t row = binary_bytes_per_row(img);
+    const std::size_t y   = img.height();
+
+    const std::size_t max_bands = std::min(std::min(thread_count(par), y),
+            std::max<std::size_t>(1, row * y / binary_chunk_size));
+    if(max_bands > 1)
+    {
+        const std::size_t rows  = (y + max_bands - 1) / max_bands;
+        const std::size_t bands = (y + rows - 1) / rows;
+        const std::size_t file_size = hdr.size() + row * y;
+
+        const int fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if(fd < 0)
+        {
+            throw std::runtime_error(std::string(func) + ": file open error: " + fname);
+        }
+        struct closer
+        {
+            int fd;
+            ~closer() noexcept {::close(fd);}
+        } guard{fd};
+
+        // fallocate reserves the blocks at once, so that the threads do not
+        // extend the file. ftruncate sets the size if it is not supported.
+#ifdef __linux__
+        ::fallocate(fd, 0, 0, static_cast<::off_t>(file_size));
+#endif
+        if(::ftruncate(fd, static_cast<::off_t>(file_size)) != 0)
+        {
+            throw std::runtime_error(std::string(func) + ": failed to allocate " +
+                    std::to_string(file_size) + " bytes: " + fname);
+        }
+
+        // the first task writes the header, and the others write the rows.
+        parallel_for(par, bands + 1, [&](const std::size_t i) {
+            const std::size_t first = (i == 0) ? 0 : (i-1) * rows;
+            pwrite_streambuf buf(fd, (i == 0) ? 0 : hdr.size() + first * row);
+            std::ostream os(&buf);
+            if(i == 0)
+            {
+                os.write(hdr.data(), static_cast<std::streamsize>(hdr.size()));
+            }
+            else
+            {
+                write_lines_binary(os, img.subview(0, first, img.width(),
+                                                   std::min(rows, y - first)));
+            }
+            if(!os.flush())
+            {
+                throw std::runtime_error(std::string(func) +
+                                         ": file write error: " + fname);
+            }
+        });
+        return;
+    }
+#else
+    static_cast<void>(par);
+#endif
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error(std::string(func) + ": file open error: " + fname);
+    }
+    ofs.write(hdr.data(), static_cast<std::streamsize>(hdr.size()));
+    write_lines_binary(ofs, img);
+    return;
+}
+} // detail
+
+inline void write_pbm_binary(const std::string& fname,
+        const const_image_view<bit_pixel>& img, const parallel_policy& par)
+{
+    return detail::write_binary_parallel(fname, img, par, "pnm::write_pbm_binary");
+}
+template<typename Alloc>
+void write_pbm_binary(const std::string& fname,
+        const image<bit_pixel, Alloc>& img, const parallel_policy& par)
+{
+    return write_pbm_binary(fname, const_image_view<bit_pixel>(img), par);
+}
+
+inline void write_pgm_binary(const std::string& fname,
+        const const_image_view<gray_pixel>& img, const parallel_policy& par)
+{
+    return detail::write_binary_parallel(fname, img, par, "pnm::write_pgm_binary");
+}
+template<typename Alloc>
+void write_pgm_binary(const std::string& fname,
+        const image<gray_pixel, Alloc>& img, const parallel_policy& par)
+{
+    return write_pgm_binary(fname, const_image_view<gray_pixel>(img), par);
+}
+inline void write_pgm_binary(const std::string& fname,
+        const const_image_view<gray16_pixel>& img, const parallel_policy& par)
+{
+    return detail::write_binary_parallel(fname, img, par, "pnm::write_pgm_binary");
+}
+template<typename Alloc>
+void write_pgm_binary(const std::string& fname,
+        const image<gray16_pixel, Alloc>& img, const parallel_policy& par)
+{
+    return write_pgm_binary(fname, const_image_view<gray16_pixel>(img), par);
+}
+
+inline void write_ppm_binary(const std::string& fname,
+        const const_image_view<rgb_pixel>& img, const parallel_policy& par)
+{
+    return detail::write_binary_parallel(fname, img, par, "pnm::write_ppm_binary");
+}
+template<typename Alloc>
+void write_ppm_binary(const std::string& fname,
+        const image<rgb_pixel, Alloc>& img, const parallel_policy& par)
+{
+    return write_ppm_binary(fname, const_image_view<rgb_pixel>(img), par);
+}
+inline void write_ppm_binary(const std::string& fname,
+        const const_image_view<rgb16_pixel>& img, const parallel_policy& par)
+{
+    return detail::write_binary_parallel(fname, img, par, "pnm::write_ppm_binary");
+}
+template<typename Alloc>
+void write_ppm_binary(const std::string& fname,
+        const image<rgb16_pixel, Alloc>& img, const parallel_policy& par)
+{
+    return write_ppm_binary(fname, const_image_view<rgb16_pixel>(img), par);
+}
+
+// ascii files are written on the calling thread.
+template<typename Pixel>
+void write(const std::string& fname, const const_image_view<Pixel>& img,
+           const format fmt, const parallel_policy& par)
+{
+    if(fmt == format::binary)
+    {
+        return detail::write_binary_parallel(fname, img, par, "pnm::write");
+    }
+    return write(fname, img, fmt);
+}
+template<typename Pixel, typename Alloc>
+void write(const std::string& fname, const image<Pixel, Alloc>& img,
+           const format fmt, const parallel_policy& par)
+{
+    return write(fname, const_image_view<Pixel>(img), fmt, par);
+}
+template<typename Pixel, std::size_t Alignment>
+void write(const std::string& fname, const aligned_image<Pixel, Alignment>& img,
+           const format fmt, const parallel_policy& par)
+{
+    return write(fname, const_image_view<Pixel>(img), fmt, par);
+}
+
+// --------------------------------------------------------------------------
+// pam (P7) files have a header that consists of key-value lines. only
+// binary format exists. the depth and tuple type follow the pixel type.
+// --------------------------------------------------------------------------
+
+namespace detail
+{
+template<typename Pixel> struct pam_tuple_type;
+template<typename T> struct pam_tuple_type<basic_pixel<T, 1>>
+{static constexpr const char* name() noexcept {return "GRAYSCALE";}};
+template<typename T> struct pam_tuple_type<basic_pixel<T, 2>>
+{static constexpr const char* name() noexcept {return "GRAYSCALE_ALPHA";}};
+template<typename T> struct pam_tuple_type<basic_pixel<T, 3>>
+{static constexpr const char* name() noexcept {return "RGB";}};
+template<typename T> struct pam_tuple_type<basic_pixel<T, 4>>
+{static constexpr const char* name() noexcept {return "RGB_ALPHA";}};
+} // detail
+
+template<typename T>
+void write_pam(const std::string& fname, const basic_image_view<T>& img)
+{
+    using pixel_type = typename basic_image_view<T>::pixel_type;
+    using value_type = typename pixel_type::value_type;
+    static_assert(std::is_same<value_type, std::uint8_t >::value ||
+                  std::is_same<value_type, std::uint16_t>::value,
+                  "pnm::write_pam supports 8-bit and 16-bit samples");
+
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error("pnm::write_pam: file open error: " + fname);
+    }
+
+    ofs << "P7\nWIDTH "  << img.x_size()
+        << "\nHEIGHT "   << img.y_size()
+        << "\nDEPTH "    << pixel_type::colors
+        << "\nMAXVAL "   << (sizeof(value_type) == 2 ? 65535 : 255)
+        << "\nTUPLTYPE " << detail::pam_tuple_type<pixel_type>::name()
+        << "\nENDHDR\n";
+
+    detail::write_lines_binary(ofs, const_image_view<pixel_type>(img));
+    return ;
+}
+template<typename Pixel, typename Alloc>
+void write_pam(const std::string& fname, const image<Pixel, Alloc>& img)
+{
+    return write_pam(fname, const_image_view<Pixel>(img));
+}
+
+// --------------------------------------------------------------------------
+// pfm files store floats in the native byte order, from bottom to top. the
+// sign of scale in the header tells the byte order.
+// --------------------------------------------------------------------------
+
+template<typename T>
+void write_pfm(const std::string& fname, const basic_image_view<T>& img,
+               const double scale = 1.0)
+{
+    using pixel_type = typename basic_image_view<T>::pixel_type;
+    static_assert(std::is_same<pixel_type, grayf_pixel>::value ||
+                  std::is_same<pixel_type,  rgbf_pixel>::value,
+                  "pnm::write_pfm supports grayf_pixel and rgbf_pixel");
+    if(!(0.0 < scale) || !std::isfinite(scale))
+    {
+        throw std::out_of_range("pnm::write_pfm: scale (" +
+            std::to_string(scale) + ") should be a positive number");
+    }
+
+    std::ofstream ofs(fname, std::ios::binary);
+    if(!ofs.good())
+    {
+        throw std::runtime_error("pnm::write_pfm: file open error: " + fname);
+    }
+    ofs.imbue(std::locale::classic());
+#ifdef PNM_BIG_ENDIAN
+    const double signed_scale =  scale;
+#else
+    const double signed_scale = -scale;
+#endif
+    ofs << (pixel_type::colors == 3 ? "PF\n" : "Pf\n")
+        << img.x_size() << ' ' << img.y_size() << '\n' << signed_scale << '\n';
+
+    for(std::size_t j=img.height(); j != 0; --j)
+    {
+        ofs.write(reinterpret_cast<const char*>(img.row_ptr(j-1)),
+                  static_cast<std::streamsize>(img.width() * sizeof(pixel_type)));
+    }
+    return ;
+}
+template<typename Pixel, typename Alloc>
+void write_pfm(const std::string& fname, const image<Pixel, Alloc>& img,
+               const double scale = 1.0)
+{
+    return write_pfm(fname, const_image_view<Pixel>(img), scale);
+}
+
+// --------------------------------------------------------------------------
+// scanline_writer writes a header first and then accepts lines one by one,
+// so that the whole image does not need to be on memory.
+// --------------------------------------------------------------------------
+
+template<typename Pixel>
+class scanline_writer
+{
+    static_assert(std::is_same<Pixel,  bit_pixel>::value ||
+                  std::is_same<Pixel, gray_pixel>::value ||
+                  std::is_same<Pixel,  rgb_pixel>::value,
+                  "pnm::scanline_writer supports bit, gray, and rgb pixels");
+  public:
+    using pixel_type = Pixel;
+
+    scanline_writer(const std::string& fname, const std::size_t width,
+                    const std::size_t height, const format fmt,
+                    const std::size_t maxval = 255)
+        : fname_(fname), ofs_(fname, std::ios::binary), fmt_(fmt),
+          nx_(width), ny_(height), iy_(0), closed_(false)
+    {
+        if(!ofs_.good())
+        {
+            throw std::runtime_error(
+                    "pnm::scanline_writer: file open error: " + fname);
+        }
+        const bool is_pbm = std::is_same<Pixel, bit_pixel>::value;
+        if(!is_pbm && (maxval == 0 || 255 < maxval))
+        {
+            throw std::out_of_range("pnm::scanline_writer: maxval (" +
+                std::to_string(maxval) + ") should be in [1, 255]");
+        }
+        ofs_ << 'P' << (fmt == format::ascii ? detail::pnm_magic<Pixel>::ascii() :
+                                               detail::pnm_magic<Pixel>::binary())
+             << '\n' << width << ' ' << height << '\n';
+        if(!is_pbm) {ofs_ << maxval << '\n';}
+    }
+    ~scanline_writer() noexcept
+    {
+        // errors are reported only by an explicit close().
+        try {if(!closed_) {ofs_.close();}} catch(...) {}
+    }
+
+    scanline_writer(const scanline_writer&) = delete;
+    scanline_writer& operator=(const scanline_writer&) = delete;
+
+    std::size_t width()         const noexcept {return nx_;}
+    std::size_t height()        const noexcept {return ny_;}
+    std::size_t lines_written() const noexcept {return iy_;}
+
+    // writes `width()` pixels.
+    void write_line(const pixel_type* line)
+    {
+        if(closed_)
+        {
+            throw std::runtime_error("pnm::scanline_writer::write_line: "
+                    "file " + fname_ + " is already closed");
+        }
+        if(iy_ == ny_)
+        {
+            throw std::out_of_range("pnm::scanline_writer::write_line: "
+                "file " + fname_ + " already has " + std::to_string(ny_) +
+                " lines");
+        }
+        if(fmt_ == format::ascii)
+        {
+            detail::write_line_ascii(ofs_, line, nx_, buf_);
+        }
+        else
+        {
+            detail::write_line_binary(ofs_, line, nx_, buf_);
+        }
+        this->iy_ += 1;
+        return;
+    }
+    // accepts anything that has begin() and end(), e.g. line_proxy or vector.
+    template<typename Range, typename std::enable_if<
+        !std::is_pointer<Range>::value, std::nullptr_t>::type = nullptr>
+    void write_line(const Range& line)
+    {
+        return this->write_line(line.begin(), line.end());
+    }
+    template<typename Iterator>
+    void write_line(Iterator first, Iterator last)
+    {
+        const auto n = std::distance(first, last);
+        if(n < 0 || static_cast<std::size_t>(n) != nx_)
+        {
+            throw std::out_of_range("pnm::scanline_writer::write_line: "
+                "length of the line (" + std::to_string(n) +
+                ") differs from width (" + std::to_string(nx_) + ")");
+        }
+        line_.assign(first, last);
+        return this->write_line(line_.data());
+    }
+
+    // writes `n` lines stored contiguously.
+    void write_lines(const pixel_type* lines, const std::size_t n)
+    {
+        for(std::size_t i=0; i<n; ++i) {this->write_line(lines + i * nx_);}
+        return;
+    }
+    void write_lines(const const_image_view<pixel_type>& view)
+    {
+        if(view.width() != nx_)
+        {
+            throw std::out_of_range("pnm::scanline_writer::write_lines: "
+                "width of the view (" + std::to_string(view.width()) +
+                ") differs from the file (" + std::to_string(nx_) + ")");
+        }
+        for(std::size_t j=0; j<view.height(); ++j)
+        {
+            this->write_line(view.row_ptr(j));
+        }
+        return;
+    }
+
+    // flushes the file and checks that all the lines are written.
+    void close()
+    {
+        if(closed_) {return;}
+        closed_ = true;
+        ofs_.close();
+        if(iy_ != ny_)
+        {
+            throw std::runtime_error("pnm::scanline_writer::close: file " +
+                fname_ + " has " + std::to_string(iy_) + " lines, but " +
+                std::to_string(ny_) + " lines are expected");
+        }
+        if(ofs_.fail())
+        {
+            throw std::runtime_error(
+                    "pnm::scanline_writer::close: failed to write " + fname_);
+        }
+        return;
+    }
+
+  private:
+    std::string   fname_;
+    std::ofstream ofs_;
+    format        fmt_;
+    std::size_t   nx_, ny_, iy_;
+    bool          closed_;
+    std::vector<char>       buf_;
+    std::vector<pixel_type> line_;
+};
+
+// --------------------------------------------------------------------------
+// read_batch and write_batch read or write many files on a pool of threads.
+// each thread takes the next file from a shared counter, so that a large file
+// does not hold back the small ones. an error in a file is stored in its
+// result and does not stop the others.
+// --------------------------------------------------------------------------
+
+// the throughput of a batch.
+struct batch_stats
+{
+    std::size_t files   = 0; // the number of files
+    std::size_t failed  = 0; // the number of files that caused an error
+    std::size_t pixels  = 0; // the total number of pixels read or written
+    double      seconds = 0.0;
+
+    double files_per_second() const noexcept
+    {
+        return (seconds == 0.0) ? 0.0 : static_cast<double>(files) / seconds;
+    }
+    double pixels_per_second() const noexcept
+    {
+        return (seconds == 0.0) ? 0.0 : static_cast<double>(pixels) / seconds;
+    }
+};
+
+template<typename Pixel = rgb_pixel, typename Alloc = std::allocator<Pixel>>
+struct read_batch_result
+{
+    image<Pixel, Alloc> img;
+    std::exception_ptr  error; // null if the file is read successfully
+};
+
+template<typename Pixel>
+struct write_batch_item
+{
+    std::string             fname;
+    const_image_view<Pixel> img;
+    format                  fmt;
+};
+
+namespace detail
+{
+// calls `func(i)` for i in [0, n) in thread_count(par) tasks. each task takes
+// the next index from a shared counter. `func` must not throw.
+template<typename F>
+void parallel_for_each(const parallel_policy& par, const std::size_t n, F&& func)
+{
+    std::atomic<std::size_t> next(0);
+    parallel_for(par, std::min(thread_count(par), n),
+        [&next, n, &func](const std::size_t) {
+            for(std::size_t i = next++; i < n; i = next++)
+            {
+                func(i);
+            }
+        });
+    return;
+}
+} // detail
+
+// the results are in the same order as `fnames`.
+template<typename Pixel = rgb_pixel, typename Alloc = std::allocator<Pixel>>
+std::vector<read_batch_result<Pixel, Alloc>>
+read_batch(const std::vector<std::string>& fnames,
+           const parallel_policy& par = parallel_policy(),
+           batch_stats* stats = nullptr)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<read_batch_result<Pixel, Alloc>> results(fnames.size());
+    detail::parallel_for_each(par, fnames.size(),
+        [&fnames, &results](const std::size_t i) noexcept {
+            try
+            {
+                results[i].img = read<Pixel, Alloc>(fnames[i]);
+            }
+            catch(...)
+            {
+                results[i].error = std::current_exception();
+            }
+        });
+
+    if(stats != nullptr)
+    {
+        *stats = batch_stats();
+        stats->files = results.size();
+        for(const auto& result : results)
+        {
+            if(result.error) {stats->failed += 1;}
+            stats->pixels += result.img.size();
+        }
+        stats->seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+    return results;
+}
+
+// returns the errors in the same order as `items`. an element is null if the
+// file is written successfully.
+template<typename Pixel>
+std::vector<std::exception_ptr>
+write_batch(const std::vector<write_batch_item<Pixel>>& items,
+            const parallel_policy& par = parallel_policy(),
+            batch_stats* stats = nullptr)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::exception_ptr> errors(items.size());
+    detail::parallel_for_each(par, items.size(),
+        [&items, &errors](const std::size_t i) noexcept {
+            try
+            {
+                write(items[i].fname, items[i].img, items[i].fmt);
+            }
+            catch(...)
+            {
+                errors[i] = std::current_exception();
+            }
+        });
+
+    if(stats != nullptr)
+    {
+        *stats = batch_stats();
+        stats->files = items.size();
+        for(std::size_t i=0; i<items.size(); ++i)
+        {
+            if(errors[i]) {stats->failed += 1; continue;}
+            stats->pixels += items[i].img.size();
+        }
+        stats->seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+    return errors;
 }
 
 // --------------------------------------------------------------------------
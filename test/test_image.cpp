@@ -165,3 +165,326 @@ TEST_CASE("test access to ppm images", "[ppm access]")
         }
     }
 }
+
+TEST_CASE("test image_view", "[image_view]")
+{
+    using namespace pnm::literals;
+
+    pnm::image<pnm::gray_pixel> img(8, 6);
+    for(std::size_t y=0; y<6; ++y)
+    {
+        for(std::size_t x=0; x<8; ++x)
+        {
+            img(x, y) = pnm::gray_pixel(static_cast<std::uint8_t>(y * 8 + x));
+        }
+    }
+
+    SECTION("view of a whole image")
+    {
+        const pnm::const_image_view<pnm::gray_pixel> view(img);
+        REQUIRE(view.width()  == 8);
+        REQUIRE(view.height() == 6);
+        REQUIRE(view.stride() == 8);
+        for(std::size_t y=0; y<6; ++y)
+        {
+            for(std::size_t x=0; x<8; ++x)
+            {
+                REQUIRE(view(x, y) == img(x, y));
+                REQUIRE(view[y][x] == img[y][x]);
+            }
+        }
+    }
+
+    SECTION("sub-region")
+    {
+        pnm::image_view<pnm::gray_pixel> view(img);
+        const auto roi = view.subview(2, 1, 3, 4);
+        REQUIRE(roi.width()  == 3);
+        REQUIRE(roi.height() == 4);
+        REQUIRE(roi.stride() == 8);
+        REQUIRE(!roi.is_contiguous());
+
+        std::size_t y = 0;
+        for(const auto line : roi.lines())
+        {
+            REQUIRE(line.width() == 3);
+            for(std::size_t x=0; x<3; ++x)
+            {
+                REQUIRE(line.at(x) == img(x + 2, y + 1));
+            }
+            ++y;
+        }
+        REQUIRE(y == 4);
+
+        roi(0, 0) = 255_gray;
+        REQUIRE(img(2, 1) == 255_gray);
+
+        const auto inner = roi.subview(1, 1, 2, 2);
+        REQUIRE(inner(0, 0) == img(3, 2));
+        REQUIRE_THROWS_AS(roi.subview(2, 0, 2, 1), std::out_of_range);
+
+        const auto copied = pnm::convert_image<pnm::rgb_pixel>(roi);
+        REQUIRE(copied.width()  == 3);
+        REQUIRE(copied.height() == 4);
+        REQUIRE(copied(1, 1) == pnm::convert_to<pnm::rgb_pixel>(img(3, 2)));
+    }
+
+    SECTION("view of an external buffer")
+    {
+        std::vector<pnm::rgb_pixel> buffer(4 * 3, 0x000000_rgb);
+        pnm::image_view<pnm::rgb_pixel> view(buffer.data(), 3, 3, 4);
+        view[1][2] = 0xFF0000_rgb;
+        REQUIRE(buffer.at(1 * 4 + 2) == 0xFF0000_rgb);
+        REQUIRE_THROWS_AS(pnm::image_view<pnm::rgb_pixel>(buffer.data(), 5, 2, 4),
+                          std::out_of_range);
+    }
+}
+
+TEST_CASE("test packed_bit_image", "[packed_bit_image]")
+{
+    using namespace pnm::literals;
+
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::bernoulli_distribution dist(0.5);
+
+    pnm::image<pnm::bit_pixel> img(13, 7);
+    for(auto& pix : img) {pix = pnm::bit_pixel(dist(mt));}
+
+    pnm::packed_bit_image<> packed(img);
+    REQUIRE(packed.width()          == 13);
+    REQUIRE(packed.height()         == 7);
+    REQUIRE(packed.bytes_per_line() == 2);
+    REQUIRE(packed.bytes()          == 14);
+
+    SECTION("access to bits")
+    {
+        for(std::size_t y=0; y<img.height(); ++y)
+        {
+            for(std::size_t x=0; x<img.width(); ++x)
+            {
+                REQUIRE(packed(x, y) == img(x, y));
+            }
+        }
+        packed(12, 6) = 1_bit;
+        REQUIRE(packed(12, 6) == 1_bit);
+        packed(12, 6) = 0_bit;
+        REQUIRE(packed(12, 6) == 0_bit);
+        packed(0, 0) = packed(1, 0) = 1_bit;
+        REQUIRE(packed.row_data(0)[0] >= 0xC0);
+
+        const auto& cref = packed;
+        REQUIRE(cref(0, 0) == 1_bit);
+        REQUIRE_THROWS_AS(packed.at(13, 0), std::out_of_range);
+        REQUIRE_THROWS_AS(cref.at(0, 7),    std::out_of_range);
+    }
+
+    SECTION("pack and unpack")
+    {
+        const auto unpacked = packed.unpack();
+        REQUIRE(std::equal(unpacked.begin(), unpacked.end(), img.begin()));
+
+        // padding bits are kept zero
+        const pnm::packed_bit_image<> black(13, 7, 1_bit);
+        REQUIRE(black.row_data(3)[0] == 0xFF);
+        REQUIRE(black.row_data(3)[1] == 0xF8);
+        const auto unpacked_black = black.unpack();
+        REQUIRE(std::all_of(unpacked_black.begin(), unpacked_black.end(),
+                [](const pnm::bit_pixel& pix) {return pix.value;}));
+    }
+}
+
+TEST_CASE("test convert_image with narrowing_policy", "[narrowing]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<int> dist(0, 255);
+
+    // widths that are not multiples of the SIMD width
+    pnm::image<pnm::rgb_pixel> img(77, 5);
+    for(auto& pix : img)
+    {
+        pix = pnm::rgb_pixel(static_cast<std::uint8_t>(dist(mt)),
+                             static_cast<std::uint8_t>(dist(mt)),
+                             static_cast<std::uint8_t>(dist(mt)));
+    }
+    REQUIRE_THROWS(pnm::convert_image<pnm::gray_pixel, std::allocator<pnm::gray_pixel>>(img));
+
+    for(const auto coef : {pnm::luminance::bt601, pnm::luminance::bt709})
+    {
+        const pnm::narrowing_policy policy(coef, 64);
+        const auto gray = pnm::convert_image<pnm::gray_pixel>(img, policy);
+        const auto bits = pnm::convert_image<pnm::bit_pixel>(img, policy);
+        for(std::size_t i=0; i<img.size(); ++i)
+        {
+            const auto g = pnm::convert_to<pnm::gray_pixel>(img.raw_access(i), policy);
+            REQUIRE(gray.raw_access(i) == g);
+            REQUIRE(bits.raw_access(i).value == (g.value < 64));
+        }
+
+        // strided view
+        const auto roi = pnm::const_image_view<pnm::rgb_pixel>(img).subview(3, 1, 70, 3);
+        const auto gray_roi = pnm::convert_image<pnm::gray_pixel>(roi, policy);
+        REQUIRE(gray_roi.width()  == 70);
+        REQUIRE(gray_roi.height() == 3);
+        REQUIRE(gray_roi(69, 2) == gray(72, 3));
+    }
+}
+
+TEST_CASE("test image::resize", "[resize]")
+{
+    pnm::image<pnm::gray_pixel> img;
+    REQUIRE(img.width()  == 0);
+    REQUIRE(img.height() == 0);
+    REQUIRE(img.size()   == 0);
+
+    img.resize(8, 4);
+    REQUIRE(img.width()  == 8);
+    REQUIRE(img.height() == 4);
+    REQUIRE(img.size()   == 32);
+
+    // the same size keeps the buffer and pixels
+    img(7, 3) = pnm::gray_pixel(42);
+    const auto* const data = img.data();
+    img.resize(8, 4);
+    REQUIRE(img.data() == data);
+    REQUIRE(img(7, 3) == pnm::gray_pixel(42));
+
+    // shrinking does not reallocate
+    img.resize(4, 2);
+    REQUIRE(img.width()  == 4);
+    REQUIRE(img.height() == 2);
+    REQUIRE(img.data()   == data);
+}
+
+TEST_CASE("test aligned_image", "[aligned_image]")
+{
+    // rgb_pixel is 3 bytes, so a 64-byte aligned row has a multiple of 64 pixels
+    pnm::aligned_image<pnm::rgb_pixel> img(77, 5, pnm::rgb_pixel(1, 2, 3));
+    REQUIRE(img.width()  == 77);
+    REQUIRE(img.height() == 5);
+    REQUIRE(img.size()   == 77 * 5);
+    REQUIRE(img.stride() == 128);
+    for(std::size_t j=0; j<img.height(); ++j)
+    {
+        REQUIRE(reinterpret_cast<std::uintptr_t>(img.row_ptr(j)) % 64 == 0);
+    }
+    REQUIRE(pnm::aligned_image<pnm::gray_pixel, 32>::min_stride(33) == 64);
+    REQUIRE(pnm::aligned_image<pnm::gray16_pixel, 32>::min_stride(16) == 16);
+
+    img(76, 4) = pnm::rgb_pixel(4, 5, 6);
+    REQUIRE(img.at(76, 4) == pnm::rgb_pixel(4, 5, 6));
+    REQUIRE(img.row_ptr(4)[76] == pnm::rgb_pixel(4, 5, 6));
+    REQUIRE_THROWS_AS(img.at(77, 0), std::out_of_range);
+    REQUIRE_THROWS_AS(img.at(0, 5),  std::out_of_range);
+
+    // views see the padding as a stride
+    const pnm::const_image_view<pnm::rgb_pixel> view(img);
+    REQUIRE(view.stride() == img.stride());
+    REQUIRE(!view.is_contiguous());
+    REQUIRE(view(76, 4) == pnm::rgb_pixel(4, 5, 6));
+
+    const auto copied = pnm::convert_image<pnm::rgb_pixel>(view);
+    const pnm::aligned_image<pnm::rgb_pixel> from_image(copied);
+    REQUIRE(from_image(76, 4) == pnm::rgb_pixel(4, 5, 6));
+    REQUIRE(from_image(0, 0)  == pnm::rgb_pixel(1, 2, 3));
+
+    // explicit stride
+    pnm::aligned_image<pnm::gray_pixel, 32> wide(10, 3, std::size_t(96));
+    REQUIRE(wide.stride() == 96);
+    REQUIRE_THROWS_AS((pnm::aligned_image<pnm::gray_pixel, 32>(10, 3, std::size_t(40))),
+                      std::out_of_range);
+    REQUIRE_THROWS_AS((pnm::aligned_image<pnm::gray_pixel, 32>(40, 3, std::size_t(32))),
+                      std::out_of_range);
+
+    // resizing resets the stride
+    wide.resize(40, 2);
+    REQUIRE(wide.width()  == 40);
+    REQUIRE(wide.height() == 2);
+    REQUIRE(wide.stride() == 64);
+
+    // image has the same interface without padding
+    pnm::image<pnm::gray_pixel> tight(10, 3);
+    REQUIRE(tight.stride() == 10);
+    REQUIRE(tight.row_ptr(2) == tight.data() + 20);
+}
+
+namespace
+{
+// runs the tasks on the calling thread and counts them.
+struct counting_executor final : public pnm::executor
+{
+    std::size_t concurrency() const noexcept override {return 4;}
+    void execute(const std::size_t n,
+                 const std::function<void(std::size_t)>& task) override
+    {
+        for(std::size_t i=0; i<n; ++i) {task(i);}
+        tasks += n;
+    }
+    std::size_t tasks = 0;
+};
+} // anonymous
+
+TEST_CASE("test executor", "[executor]")
+{
+    {
+        pnm::thread_pool pool(4);
+        REQUIRE(pool.concurrency() == 4);
+
+        std::vector<std::size_t> values(1000, 0);
+        pool.execute(values.size(), [&values](const std::size_t i) {values[i] = i;});
+        for(std::size_t i=0; i<values.size(); ++i)
+        {
+            REQUIRE(values[i] == i);
+        }
+
+        // execute can be called from inside a task
+        std::atomic<std::size_t> count(0);
+        pool.execute(8, [&pool, &count](const std::size_t) {
+            pool.execute(100, [&count](const std::size_t) {count += 1;});
+        });
+        REQUIRE(count == 800);
+        pool.execute(0, [](const std::size_t) {});
+    }
+    {
+        pnm::inline_executor serial;
+        REQUIRE(serial.concurrency() == 1);
+        std::vector<std::size_t> order;
+        serial.execute(5, [&order](const std::size_t i) {order.push_back(i);});
+        REQUIRE(order == std::vector<std::size_t>{0, 1, 2, 3, 4});
+    }
+
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<int> dist(0, 255);
+    // large enough to be split into 4 tasks of 1 MiB
+    pnm::image<pnm::rgb_pixel> img(2048, 2049);
+    for(auto& pix : img)
+    {
+        pix = pnm::rgb_pixel(static_cast<std::uint8_t>(dist(mt)),
+                             static_cast<std::uint8_t>(dist(mt)),
+                             static_cast<std::uint8_t>(dist(mt)));
+    }
+    const pnm::narrowing_policy policy;
+    const auto gray = pnm::convert_image<pnm::gray_pixel>(img, policy);
+    const auto rgba = pnm::convert_image<pnm::rgba_pixel>(
+            pnm::const_image_view<pnm::rgb_pixel>(img));
+
+    // convert_image splits rows into tasks on the executor
+    counting_executor counter;
+    const auto gray_par = pnm::convert_image<pnm::gray_pixel>(img, policy, counter);
+    REQUIRE(counter.tasks == 4);
+    REQUIRE(std::equal(gray.begin(), gray.end(), gray_par.begin()));
+
+    pnm::thread_pool pool(3);
+    const auto rgba_par = pnm::convert_image<pnm::rgba_pixel>(img, pool);
+    REQUIRE(std::equal(rgba.begin(), rgba.end(), rgba_par.begin()));
+    const auto rgba_def = pnm::convert_image<pnm::rgba_pixel>(img, pnm::parallel_policy(5));
+    REQUIRE(std::equal(rgba.begin(), rgba.end(), rgba_def.begin()));
+
+    const auto roi = pnm::const_image_view<pnm::rgb_pixel>(img).subview(3, 1, 2040, 2047);
+    const auto roi_par = pnm::convert_image<pnm::gray_pixel>(roi, policy,
+            pnm::parallel_policy(pool, 7));
+    REQUIRE(roi_par(2039, 2046) == gray(2042, 2047));
+    REQUIRE(roi_par(0, 0) == gray(3, 1));
+}
@@ -2,6 +2,9 @@
 #include <extlib/catch.hpp>
 #include <pnm.hpp>
 #include <random>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
 
 namespace pnm
 {
@@ -154,3 +157,1211 @@ TEST_CASE("test input/output for ppm images", "[ppm io]")
         REQUIRE(img == binary);
     }
 }
+
+TEST_CASE("test binary input for large images", "[binary io]")
+{
+    // large enough to be read in several chunks
+    pnm::image<pnm::rgb_pixel> img(1023, 1031);
+
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
+    for(auto& pixel : img)
+    {
+        pixel = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));
+    }
+    pnm::write("test_large.ppm", img, pnm::format::binary);
+    REQUIRE(img == pnm::read_ppm_binary("test_large.ppm"));
+
+    pnm::image<pnm::bit_pixel> bits(1029, 1031);
+    std::bernoulli_distribution coin(0.5);
+    for(auto& pixel : bits)
+    {
+        pixel = pnm::bit_pixel(coin(mt));
+    }
+    pnm::write("test_large.pbm", bits, pnm::format::binary);
+    REQUIRE(bits == pnm::read_pbm_binary("test_large.pbm"));
+}
+
+TEST_CASE("test binary input with maxval other than 255", "[binary io]")
+{
+    {
+        std::ofstream ofs("test_maxval.pgm", std::ios::binary);
+        ofs << "P5\n4 1\n15\n";
+        const char pixels[4] = {0, 1, 15, 8};
+        ofs.write(pixels, 4);
+    }
+    const auto img = pnm::read_pgm_binary("test_maxval.pgm");
+    REQUIRE(img.width()  == 4);
+    REQUIRE(img.height() == 1);
+    REQUIRE(img(0, 0).value ==   0);
+    REQUIRE(img(1, 0).value ==  16);
+    REQUIRE(img(2, 0).value == 240);
+    REQUIRE(img(3, 0).value == 128);
+
+    {
+        std::ofstream ofs("test_truncated.ppm", std::ios::binary);
+        ofs << "P6\n4 4\n255\n";
+        const char pixels[4] = {0, 1, 2, 3};
+        ofs.write(pixels, 4);
+    }
+    REQUIRE_THROWS_AS(pnm::read_ppm_binary("test_truncated.ppm"),
+                      std::runtime_error);
+}
+
+TEST_CASE("test memory-mapped binary images", "[mapped io]")
+{
+    pnm::image<pnm::rgb_pixel> img(13, 7);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
+    for(auto& pixel : img)
+    {
+        pixel = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));
+    }
+    pnm::write("test_mapped.ppm", img, pnm::format::binary);
+    pnm::write("test_mapped_ascii.ppm", img, pnm::format::ascii);
+
+    const auto mapped = pnm::map_ppm("test_mapped.ppm",
+                                     pnm::access_pattern::sequential);
+    REQUIRE(mapped.width()  == img.width());
+    REQUIRE(mapped.height() == img.height());
+    REQUIRE(std::equal(mapped.begin(), mapped.end(), img.begin()));
+
+    std::size_t y = 0;
+    for(const auto line : mapped.lines())
+    {
+        for(std::size_t x=0; x<line.width(); ++x)
+        {
+            REQUIRE(line[x] == img[y][x]);
+            REQUIRE(mapped(x, y) == img(x, y));
+            REQUIRE(mapped[y][x] == img(x, y));
+        }
+        ++y;
+    }
+    REQUIRE(y == img.height());
+
+    REQUIRE_THROWS_AS(pnm::map_ppm("test_mapped_ascii.ppm"), std::runtime_error);
+    REQUIRE_THROWS_AS(pnm::map_pgm("test_mapped.ppm"), std::runtime_error);
+}
+
+TEST_CASE("test output of image_view", "[view io]")
+{
+    pnm::image<pnm::rgb_pixel> img(10, 10);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
+    for(auto& pixel : img)
+    {
+        pixel = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));
+    }
+    const pnm::image_view<pnm::rgb_pixel> roi =
+        pnm::image_view<pnm::rgb_pixel>(img).subview(3, 2, 5, 6);
+
+    pnm::write("test_view_ascii.ppm",  roi, pnm::format::ascii);
+    pnm::write("test_view_binary.ppm", roi, pnm::format::binary);
+
+    const auto expected = pnm::convert_image<pnm::rgb_pixel>(roi);
+    REQUIRE(expected == pnm::read_ppm("test_view_ascii.ppm"));
+    REQUIRE(expected == pnm::read_ppm("test_view_binary.ppm"));
+
+    pnm::image<pnm::bit_pixel> bits(21, 9);
+    std::bernoulli_distribution coin(0.5);
+    for(auto& pixel : bits)
+    {
+        pixel = pnm::bit_pixel(coin(mt));
+    }
+    const pnm::const_image_view<pnm::bit_pixel> bits_roi =
+        pnm::const_image_view<pnm::bit_pixel>(bits).subview(2, 1, 11, 7);
+    pnm::write("test_view_binary.pbm", bits_roi, pnm::format::binary);
+    REQUIRE(pnm::convert_image<pnm::bit_pixel>(bits_roi) ==
+            pnm::read_pbm("test_view_binary.pbm"));
+}
+
+TEST_CASE("test scanline_reader", "[scanline io]")
+{
+    pnm::image<pnm::gray_pixel> img(21, 13);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
+    for(auto& pixel : img)
+    {
+        pixel = pnm::gray_pixel(dist(mt));
+    }
+    pnm::write("test_scanline_ascii.pgm",  img, pnm::format::ascii);
+    pnm::write("test_scanline_binary.pgm", img, pnm::format::binary);
+
+    pnm::image<pnm::bit_pixel> bits(21, 13);
+    std::bernoulli_distribution coin(0.5);
+    for(auto& pixel : bits)
+    {
+        pixel = pnm::bit_pixel(coin(mt));
+    }
+    pnm::write("test_scanline_ascii.pbm",  bits, pnm::format::ascii);
+    pnm::write("test_scanline_binary.pbm", bits, pnm::format::binary);
+
+    for(const std::string fname : {"test_scanline_ascii.pgm",
+                                   "test_scanline_binary.pgm"})
+    {
+        pnm::scanline_reader reader(fname);
+        REQUIRE(reader.width()  == 21);
+        REQUIRE(reader.height() == 13);
+        REQUIRE(reader.maxval() == 255);
+
+        std::vector<pnm::gray_pixel> line;
+        std::size_t y = 0;
+        while(reader.read_line(line))
+        {
+            REQUIRE(std::equal(line.begin(), line.end(), img[y].begin()));
+            ++y;
+        }
+        REQUIRE(y == 13);
+        REQUIRE(reader.eof());
+    }
+
+    for(const std::string fname : {"test_scanline_ascii.pbm",
+                                   "test_scanline_binary.pbm"})
+    {
+        // read in batches of 4 lines, converting bit_pixel -> rgb_pixel
+        pnm::scanline_reader reader(fname);
+        const auto expected = pnm::read<pnm::rgb_pixel>(fname);
+        std::vector<pnm::rgb_pixel> batch(reader.width() * 4);
+        std::size_t y = 0;
+        while(const std::size_t n = reader.read_lines(batch.data(), 4))
+        {
+            for(std::size_t j=0; j<n; ++j)
+            {
+                for(std::size_t x=0; x<reader.width(); ++x)
+                {
+                    REQUIRE(batch.at(j * reader.width() + x) == expected(x, y));
+                }
+                ++y;
+            }
+        }
+        REQUIRE(y == 13);
+    }
+
+    {
+        pnm::scanline_reader reader("test_scanline_binary.pgm");
+        pnm::image<pnm::gray_pixel> dst(21, 13);
+        REQUIRE(reader.read_lines(pnm::image_view<pnm::gray_pixel>(dst)) == 13);
+        REQUIRE(dst == img);
+    }
+}
+
+TEST_CASE("test scanline_writer", "[scanline io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
+    std::bernoulli_distribution coin(0.5);
+
+    pnm::image<pnm::rgb_pixel> rgb(17, 11);
+    for(auto& pixel : rgb)
+    {
+        pixel = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));
+    }
+    pnm::image<pnm::bit_pixel> bits(19, 11);
+    for(auto& pixel : bits)
+    {
+        pixel = pnm::bit_pixel(coin(mt));
+    }
+
+    for(const auto fmt : {pnm::format::ascii, pnm::format::binary})
+    {
+        {
+            pnm::scanline_writer<pnm::rgb_pixel> writer(
+                    "test_scanline_writer.ppm", 17, 11, fmt);
+            writer.write_line(rgb[0]);                             // line_proxy
+            writer.write_line(rgb.data() + 17);                    // pointer
+            writer.write_line(rgb[2].begin(), rgb[2].end());       // iterators
+            writer.write_lines(pnm::const_image_view<pnm::rgb_pixel>(
+                    rgb.data() + 17 * 3, 17, 8));                  // view
+            REQUIRE(writer.lines_written() == 11);
+            writer.close();
+        }
+        REQUIRE(rgb == pnm::read_ppm("test_scanline_writer.ppm"));
+
+        {
+            pnm::scanline_writer<pnm::bit_pixel> writer(
+                    "test_scanline_writer.pbm", 19, 11, fmt);
+            for(const auto line : bits.lines())
+            {
+                writer.write_line(line);
+            }
+            writer.close();
+        }
+        REQUIRE(bits == pnm::read_pbm("test_scanline_writer.pbm"));
+    }
+
+    pnm::scanline_writer<pnm::gray_pixel> writer(
+            "test_scanline_short.pgm", 4, 2, pnm::format::binary);
+    const std::vector<pnm::gray_pixel> line(4, pnm::gray_pixel(0));
+    writer.write_line(line);
+    REQUIRE_THROWS_AS(writer.write_line(std::vector<pnm::gray_pixel>(3)),
+                      std::out_of_range);
+    REQUIRE_THROWS_AS(writer.close(), std::runtime_error);
+}
+
+TEST_CASE("test ascii tokenizer", "[ascii io]")
+{
+    {
+        std::ofstream ofs("test_comment.pgm");
+        ofs << "P2\n# comment\n3 2 # another comment\n255\n"
+               "0 1\t2 # comment 3 4 5\n\n 128\r\n   64\n#\n32";
+    }
+    const auto img = pnm::read_pgm_ascii("test_comment.pgm");
+    REQUIRE(img.width()  == 3);
+    REQUIRE(img.height() == 2);
+    REQUIRE(img(0, 0).value ==   0);
+    REQUIRE(img(1, 0).value ==   1);
+    REQUIRE(img(2, 0).value ==   2);
+    REQUIRE(img(0, 1).value == 128);
+    REQUIRE(img(1, 1).value ==  64);
+    REQUIRE(img(2, 1).value ==  32);
+
+    {
+        std::ofstream ofs("test_invalid.ppm");
+        ofs << "P3\n1 1\n255\n0 1x 2\n";
+    }
+    REQUIRE_THROWS_WITH(pnm::read_ppm_ascii("test_invalid.ppm"),
+                        Catch::Contains("contains invalid token: 1x"));
+    {
+        std::ofstream ofs("test_too_many.pbm");
+        ofs << "P1\n2 1\n0 1 1\n";
+    }
+    REQUIRE_THROWS_WITH(pnm::read_pbm_ascii("test_too_many.pbm"),
+                        Catch::Contains("contains too many pixels"));
+
+    // larger than the internal buffer of the tokenizer
+    pnm::image<pnm::rgb_pixel> large(301, 297);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
+    for(auto& pixel : large)
+    {
+        pixel = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));
+    }
+    pnm::write("test_large_ascii.ppm", large, pnm::format::ascii);
+    REQUIRE(large == pnm::read_ppm_ascii("test_large_ascii.ppm"));
+}
+
+TEST_CASE("test ascii output format", "[ascii io]")
+{
+    const auto slurp = [](const std::string& fname) -> std::string {
+        std::ifstream ifs(fname);
+        return std::string(std::istreambuf_iterator<char>(ifs),
+                           std::istreambuf_iterator<char>());
+    };
+
+    pnm::image<pnm::gray_pixel> gray(256, 3);
+    pnm::image<pnm::rgb_pixel>  rgb(256, 3);
+    std::ostringstream gray_expected, rgb_expected;
+    gray_expected << "P2\n256 3\n255\n";
+    rgb_expected  << "P3\n256 3\n255\n";
+    for(std::size_t j=0; j<3; ++j)
+    {
+        for(std::size_t i=0; i<256; ++i)
+        {
+            const std::uint8_t v = static_cast<std::uint8_t>(i);
+            const std::uint8_t w = static_cast<std::uint8_t>(255 - i);
+            gray(i, j) = pnm::gray_pixel(v);
+            rgb(i, j)  = pnm::rgb_pixel(v, w, static_cast<std::uint8_t>(i * j));
+
+            gray_expected << std::setw(3) << int(v);
+            rgb_expected  << std::setw(3) << int(v) << ' '
+                          << std::setw(3) << int(w) << ' '
+                          << std::setw(3) << int(rgb(i, j).blue);
+            gray_expected << (i == 255 ? '\n' : ' ');
+            rgb_expected  << (i == 255 ? '\n' : ' ');
+        }
+    }
+    pnm::write_pgm_ascii("test_format.pgm", gray);
+    pnm::write_ppm_ascii("test_format.ppm", rgb);
+    REQUIRE(slurp("test_format.pgm") == gray_expected.str());
+    REQUIRE(slurp("test_format.ppm") == rgb_expected.str());
+
+    pnm::image<pnm::bit_pixel> bits(3, 2);
+    bits(0, 0) = pnm::bit_pixel(true);
+    bits(2, 1) = pnm::bit_pixel(true);
+    pnm::write_pbm_ascii("test_format.pbm", bits);
+    REQUIRE(slurp("test_format.pbm") == "P1\n3 2\n1 0 0\n0 0 1\n");
+}
+
+TEST_CASE("test read_header", "[header io]")
+{
+    {
+        std::ofstream ofs("test_header.ppm", std::ios::binary);
+        ofs << "P6\n# comment\n3 2\n# another comment\n15\n";
+        ofs << std::string(3 * 2 * 3, '\0');
+    }
+    const pnm::header hdr = pnm::read_header("test_header.ppm");
+    REQUIRE(hdr.magic  == '6');
+    REQUIRE(hdr.fmt    == pnm::format::binary);
+    REQUIRE(hdr.width  == 3);
+    REQUIRE(hdr.height == 2);
+    REQUIRE(hdr.maxval == 15);
+    REQUIRE(hdr.offset == 38);
+
+    pnm::image<pnm::bit_pixel> bits(10, 4);
+    pnm::write("test_header.pbm", bits, pnm::format::ascii);
+    const pnm::header pbm = pnm::read_header("test_header.pbm");
+    REQUIRE(pbm.magic  == '1');
+    REQUIRE(pbm.fmt    == pnm::format::ascii);
+    REQUIRE(pbm.width  == 10);
+    REQUIRE(pbm.height == 4);
+    REQUIRE(pbm.maxval == 1);
+    REQUIRE(pbm.offset == 8);
+
+    // the payload starts right after a single whitespace, even if the pixel
+    // values look like whitespaces or a comment.
+    {
+        std::ofstream ofs("test_header.pgm", std::ios::binary);
+        ofs << "P5 3 1 255 \n#\t";
+    }
+    const auto gray = pnm::read_pgm("test_header.pgm");
+    REQUIRE(gray.width()  == 3);
+    REQUIRE(gray(0, 0).value == '\n');
+    REQUIRE(gray(1, 0).value == '#');
+    REQUIRE(gray(2, 0).value == '\t');
+
+    {
+        std::ofstream ofs("test_incomplete.pgm", std::ios::binary);
+        ofs << "P5\n3 # 2\n";
+    }
+    REQUIRE_THROWS_WITH(pnm::read_header("test_incomplete.pgm"),
+                        Catch::Contains("has an incomplete header"));
+    {
+        std::ofstream ofs("test_invalid_header.pgm", std::ios::binary);
+        ofs << "P2\n3 2x 255\n";
+    }
+    REQUIRE_THROWS_WITH(pnm::read_header("test_invalid_header.pgm"),
+                        Catch::Contains("contains invalid token: 2x"));
+    {
+        std::ofstream ofs("test_not_pnm.pgm", std::ios::binary);
+        ofs << "GIF89a";
+    }
+    REQUIRE_THROWS_WITH(pnm::read_header("test_not_pnm.pgm"),
+                        Catch::Contains("is not any of pnm format"));
+}
+
+TEST_CASE("test input from stream and memory", "[stream io]")
+{
+    const auto slurp = [](const std::string& fname) -> std::string {
+        std::ifstream ifs(fname, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(ifs),
+                           std::istreambuf_iterator<char>());
+    };
+
+    pnm::image<pnm::rgb_pixel>  img(13, 7);
+    pnm::image<pnm::gray_pixel> gray(13, 7);
+    pnm::image<pnm::bit_pixel>  bits(13, 7);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
+    for(std::size_t i=0; i<img.size(); ++i)
+    {
+        img.raw_access(i)  = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));
+        gray.raw_access(i) = pnm::gray_pixel(dist(mt));
+        bits.raw_access(i) = pnm::bit_pixel(dist(mt) < 128);
+    }
+
+    for(const auto fmt : {pnm::format::ascii, pnm::format::binary})
+    {
+        pnm::write("test_stream.ppm", img,  fmt);
+        pnm::write("test_stream.pgm", gray, fmt);
+        pnm::write("test_stream.pbm", bits, fmt);
+        const std::string ppm = slurp("test_stream.ppm");
+        const std::string pgm = slurp("test_stream.pgm");
+        const std::string pbm = slurp("test_stream.pbm");
+
+        {
+            std::istringstream iss(ppm);
+            REQUIRE(img == pnm::read_ppm(iss));
+        }
+        {
+            std::istringstream iss(pgm);
+            REQUIRE(gray == pnm::read_pgm(iss));
+        }
+        {
+            std::istringstream iss(pbm);
+            REQUIRE(bits == pnm::read_pbm(iss));
+        }
+        {
+            std::istringstream iss(ppm);
+            REQUIRE(img == pnm::read(iss));
+        }
+        if(fmt == pnm::format::binary)
+        {
+            std::istringstream iss(pgm);
+            REQUIRE(gray == pnm::read_pgm_binary(iss));
+        }
+        else
+        {
+            std::istringstream iss(pgm);
+            REQUIRE(gray == pnm::read_pgm_ascii(iss));
+        }
+
+        REQUIRE(img  == pnm::read_ppm(ppm.data(), ppm.size()));
+        REQUIRE(gray == pnm::read_pgm(pgm.data(), pgm.size()));
+        REQUIRE(bits == pnm::read_pbm(pbm.data(), pbm.size()));
+        REQUIRE(gray == pnm::read<pnm::gray_pixel>(pgm.data(), pgm.size()));
+
+        const pnm::header hdr = pnm::read_header(pgm.data(), pgm.size());
+        REQUIRE(hdr.width  == 13);
+        REQUIRE(hdr.height ==  7);
+        REQUIRE(hdr.maxval == 255);
+    }
+
+    const std::string truncated("P6\n2 2\n255\n\x01\x02\x03", 14);
+    REQUIRE_THROWS_WITH(pnm::read_ppm(truncated.data(), truncated.size()),
+                        Catch::Contains("is truncated"));
+    REQUIRE_THROWS_WITH(pnm::read_pgm(truncated.data(), truncated.size()),
+                        Catch::Contains("is not a pgm file"));
+}
+
+TEST_CASE("test rescaling of maxval", "[maxval io]")
+{
+    {
+        std::ofstream ofs("test_maxval_ascii.pgm");
+        ofs << "P2\n5 1\n15\n0 1 15 8 20\n";
+    }
+    const auto small = pnm::read_pgm("test_maxval_ascii.pgm");
+    REQUIRE(small(0, 0).value ==   0);
+    REQUIRE(small(1, 0).value ==  16);
+    REQUIRE(small(2, 0).value == 240);
+    REQUIRE(small(3, 0).value == 128);
+    REQUIRE(small(4, 0).value == 240); // clamped to maxval
+
+    {
+        std::ofstream ofs("test_maxval_ascii.ppm");
+        ofs << "P3\n2 1\n1023\n0 512 1023  1 4 2000\n";
+    }
+    const auto large = pnm::read_ppm("test_maxval_ascii.ppm");
+    REQUIRE(large(0, 0).red   ==   0);
+    REQUIRE(large(0, 0).green == 128);
+    REQUIRE(large(0, 0).blue  == 255);
+    REQUIRE(large(1, 0).red   ==   0);
+    REQUIRE(large(1, 0).green ==   1);
+    REQUIRE(large(1, 0).blue  == 255);
+
+    {
+        std::ofstream ofs("test_maxval_zero.pgm");
+        ofs << "P2\n1 1\n0\n0\n";
+    }
+    REQUIRE_THROWS_WITH(pnm::read_pgm("test_maxval_zero.pgm"),
+                        Catch::Contains("has an invalid maxval: 0"));
+    {
+        std::ofstream ofs("test_maxval_huge.pgm");
+        ofs << "P2\n1 1\n65536\n0\n";
+    }
+    REQUIRE_THROWS_WITH(pnm::read_pgm("test_maxval_huge.pgm"),
+                        Catch::Contains("has an invalid maxval: 65536"));
+}
+
+TEST_CASE("test input/output for 16-bit images", "[16bit io]")
+{
+    pnm::image<pnm::gray16_pixel> gray(37, 11);
+    pnm::image<pnm::rgb16_pixel>  rgb(37, 11);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 65535);
+    for(std::size_t i=0; i<gray.size(); ++i)
+    {
+        gray.raw_access(i) = pnm::gray16_pixel(dist(mt));
+        rgb.raw_access(i)  = pnm::rgb16_pixel(dist(mt), dist(mt), dist(mt));
+    }
+
+    for(const auto fmt : {pnm::format::ascii, pnm::format::binary})
+    {
+        pnm::write("test_16bit.pgm", gray, fmt);
+        pnm::write("test_16bit.ppm", rgb,  fmt);
+        REQUIRE(pnm::read_header("test_16bit.pgm").maxval == 65535);
+        REQUIRE(gray == pnm::read<pnm::gray16_pixel>("test_16bit.pgm"));
+        REQUIRE(rgb  == pnm::read<pnm::rgb16_pixel >("test_16bit.ppm"));
+
+        // 8-bit readers keep the upper byte
+        const auto gray8 = pnm::read_pgm("test_16bit.pgm");
+        const auto rgb8  = pnm::read_ppm("test_16bit.ppm");
+        for(std::size_t i=0; i<gray.size(); ++i)
+        {
+            REQUIRE(gray8.raw_access(i) ==
+                    pnm::convert_to<pnm::gray_pixel>(gray.raw_access(i)));
+            REQUIRE(rgb8.raw_access(i) ==
+                    pnm::convert_to<pnm::rgb_pixel>(rgb.raw_access(i)));
+        }
+    }
+
+    // big endian samples and maxval other than 65535
+    {
+        std::ofstream ofs("test_12bit.pgm", std::ios::binary);
+        ofs << "P5\n3 1\n4095\n";
+        const unsigned char samples[6] = {0x00, 0x00, 0x08, 0x00, 0x0F, 0xFF};
+        ofs.write(reinterpret_cast<const char*>(samples), 6);
+    }
+    const auto twelve = pnm::read<pnm::gray16_pixel>("test_12bit.pgm");
+    REQUIRE(twelve(0, 0).value ==     0);
+    REQUIRE(twelve(1, 0).value == 32776);
+    REQUIRE(twelve(2, 0).value == 65535);
+    const auto twelve8 = pnm::read_pgm("test_12bit.pgm");
+    REQUIRE(twelve8(0, 0).value ==   0);
+    REQUIRE(twelve8(1, 0).value == 128);
+    REQUIRE(twelve8(2, 0).value == 255);
+
+    // 8-bit files are widened
+    pnm::image<pnm::rgb_pixel> rgb8(4, 3, pnm::rgb_pixel(1, 128, 255));
+    pnm::write("test_8bit.ppm", rgb8, pnm::format::binary);
+    const auto widened = pnm::read<pnm::rgb16_pixel>("test_8bit.ppm");
+    REQUIRE(widened(3, 2) == pnm::rgb16_pixel(257, 128 * 257, 65535));
+
+    // strided view
+    const auto roi = pnm::const_image_view<pnm::rgb16_pixel>(rgb).subview(5, 2, 7, 4);
+    pnm::write("test_16bit_view.ppm", roi, pnm::format::binary);
+    REQUIRE(pnm::convert_image<pnm::rgb16_pixel>(roi) ==
+            pnm::read<pnm::rgb16_pixel>("test_16bit_view.ppm"));
+}
+
+TEST_CASE("test input/output for pam images", "[pam io]")
+{
+    pnm::image<pnm::rgba_pixel>         rgba(37, 11);
+    pnm::image<pnm::gray_alpha_pixel>   ga(37, 11);
+    pnm::image<pnm::rgba16_pixel>       rgba16(37, 11);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 65535);
+    for(std::size_t i=0; i<rgba.size(); ++i)
+    {
+        rgba.raw_access(i) = pnm::rgba_pixel(dist(mt) & 0xFF,
+                dist(mt) & 0xFF, dist(mt) & 0xFF, dist(mt) & 0xFF);
+        ga.raw_access(i) = pnm::gray_alpha_pixel(dist(mt) & 0xFF, dist(mt) & 0xFF);
+        rgba16.raw_access(i) = pnm::rgba16_pixel(
+                dist(mt), dist(mt), dist(mt), dist(mt));
+    }
+
+    pnm::write_pam("test_rgba.pam",   rgba);
+    pnm::write_pam("test_ga.pam",     ga);
+    pnm::write_pam("test_rgba16.pam", rgba16);
+    REQUIRE(rgba   == pnm::read_pam("test_rgba.pam"));
+    REQUIRE(ga     == pnm::read_pam<pnm::gray_alpha_pixel>("test_ga.pam"));
+    REQUIRE(rgba16 == pnm::read_pam<pnm::rgba16_pixel>("test_rgba16.pam"));
+    REQUIRE(rgba   == pnm::read<pnm::rgba_pixel>("test_rgba.pam"));
+
+    const auto hdr = pnm::read_header("test_ga.pam");
+    REQUIRE(hdr.magic      == '7');
+    REQUIRE(hdr.width      == 37);
+    REQUIRE(hdr.height     == 11);
+    REQUIRE(hdr.depth      == 2);
+    REQUIRE(hdr.maxval     == 255);
+    REQUIRE(hdr.tuple_type == "GRAYSCALE_ALPHA");
+
+    // pixels without alpha become opaque
+    {
+        pnm::image<pnm::rgb_pixel> rgb(4, 3, pnm::rgb_pixel(1, 2, 3));
+        pnm::write_pam("test_rgb.pam", rgb);
+        const auto widened = pnm::read_pam("test_rgb.pam");
+        REQUIRE(widened(3, 2) == pnm::rgba_pixel(1, 2, 3, 255));
+        REQUIRE(pnm::read_header("test_rgb.pam").tuple_type == "RGB");
+    }
+
+    // comments, tuple type that spans several lines, and an unknown field
+    {
+        const char data[] = "P7\n# comment\nWIDTH 2\nHEIGHT 1\nDEPTH 2\n"
+                "MAXVAL 15\nTUPLTYPE GRAYSCALE\nTUPLTYPE _ALPHA\nENDHDR\n"
+                "\x0F\x00\x03\x0F";
+        const std::string pam(data, sizeof(data) - 1);
+        const auto hdr2 = pnm::read_header(pam.data(), pam.size());
+        REQUIRE(hdr2.tuple_type == "GRAYSCALE _ALPHA");
+        const auto img = pnm::read_pam<pnm::gray_alpha_pixel>(pam.data(), pam.size());
+        REQUIRE(img(0, 0) == pnm::gray_alpha_pixel(240,   0));
+        REQUIRE(img(1, 0) == pnm::gray_alpha_pixel( 48, 240));
+
+        const char unknown_data[] = "P7\nWIDTH 1\nHEIGHT 1\nDEPTH 1\n"
+                "MAXVAL 255\nCOLORS 3\nENDHDR\n\x00";
+        const std::string unknown(unknown_data, sizeof(unknown_data) - 1);
+        REQUIRE_THROWS_AS(pnm::read_pam(unknown.data(), unknown.size()),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(pnm::read_pam("test_8bit.ppm"), std::runtime_error);
+    }
+}
+
+TEST_CASE("test input/output for pfm images", "[pfm io]")
+{
+    pnm::image<pnm::rgbf_pixel>  rgb(37, 11);
+    pnm::image<pnm::grayf_pixel> gray(37, 11);
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_real_distribution<float> dist(-10.0f, 10.0f);
+    for(std::size_t i=0; i<rgb.size(); ++i)
+    {
+        rgb.raw_access(i)  = pnm::rgbf_pixel(dist(mt), dist(mt), dist(mt));
+        gray.raw_access(i) = pnm::grayf_pixel(dist(mt));
+    }
+
+    pnm::write_pfm("test_rgb.pfm",  rgb);
+    pnm::write_pfm("test_gray.pfm", gray, 2.5);
+    REQUIRE(rgb  == pnm::read_pfm("test_rgb.pfm"));
+    REQUIRE(gray == pnm::read_pfm<pnm::grayf_pixel>("test_gray.pfm"));
+    REQUIRE(rgb  == pnm::read<pnm::rgbf_pixel>("test_rgb.pfm"));
+
+    const auto hdr = pnm::read_header("test_gray.pfm");
+    REQUIRE(hdr.magic  == 'f');
+    REQUIRE(hdr.width  == 37);
+    REQUIRE(hdr.height == 11);
+    REQUIRE(hdr.depth  == 1);
+    REQUIRE(std::abs(hdr.scale) == 2.5);
+
+    // both byte orders, rows from bottom to top
+    {
+        const char little[] = "Pf\n2 2\n-1.0\n"
+            "\x00\x00\x80\x3f" "\x00\x00\x00\x40"  // bottom row: 1, 2
+            "\x00\x00\x40\x40" "\x00\x00\x80\x40"; // top row:    3, 4
+        const char big[] = "Pf\n2 2\n1.0\n"
+            "\x3f\x80\x00\x00" "\x40\x00\x00\x00"
+            "\x40\x40\x00\x00" "\x40\x80\x00\x00";
+        for(const auto& data : {std::string(little, sizeof(little) - 1),
+                                std::string(big,    sizeof(big)    - 1)})
+        {
+            const auto img = pnm::read_pfm<pnm::grayf_pixel>(data.data(), data.size());
+            REQUIRE(img(0, 0).value == 3.0f);
+            REQUIRE(img(1, 0).value == 4.0f);
+            REQUIRE(img(0, 1).value == 1.0f);
+            REQUIRE(img(1, 1).value == 2.0f);
+        }
+    }
+
+    // 8-bit images are widened into [0, 1]
+    const auto widened = pnm::convert_image<pnm::rgbf_pixel>(
+        pnm::const_image_view<pnm::rgb_pixel>(pnm::image<pnm::rgb_pixel>(
+            2, 2, pnm::rgb_pixel(0, 51, 255))));
+    REQUIRE(widened(1, 1) == pnm::rgbf_pixel(0.0f, 0.2f, 1.0f));
+
+    REQUIRE_THROWS_AS(pnm::write_pfm("test_rgb.pfm", rgb, 0.0), std::out_of_range);
+    REQUIRE_THROWS_AS(pnm::read_pfm("test_rgba.pam"), std::runtime_error);
+}
+
+TEST_CASE("test input/output for packed pbm images", "[packed io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::bernoulli_distribution dist(0.5);
+
+    for(const std::size_t width : {1u, 8u, 13u, 64u})
+    {
+        pnm::image<pnm::bit_pixel> img(width, 5);
+        for(auto& pix : img) {pix = pnm::bit_pixel(dist(mt));}
+        const pnm::packed_bit_image<> packed(img);
+
+        for(const auto fmt : {pnm::format::ascii, pnm::format::binary})
+        {
+            // packed and unpacked images are written in the same way
+            pnm::write("test_packed.pbm",   packed, fmt);
+            pnm::write("test_unpacked.pbm", img,    fmt);
+            std::ifstream ifs1("test_packed.pbm",   std::ios::binary);
+            std::ifstream ifs2("test_unpacked.pbm", std::ios::binary);
+            const std::string file1((std::istreambuf_iterator<char>(ifs1)),
+                                     std::istreambuf_iterator<char>());
+            const std::string file2((std::istreambuf_iterator<char>(ifs2)),
+                                     std::istreambuf_iterator<char>());
+            REQUIRE(file1 == file2);
+
+            REQUIRE(packed == pnm::read_pbm_packed("test_packed.pbm"));
+            REQUIRE(packed == pnm::read_pbm_packed(file1.data(), file1.size()));
+        }
+    }
+
+    // garbage in the padding bits is ignored
+    const char data[] = "P4\n3 1\n\xBF";
+    const auto three = pnm::read_pbm_packed(data, sizeof(data) - 1);
+    pnm::packed_bit_image<> expected(3, 1, pnm::bit_pixel(true));
+    expected(1, 0) = pnm::bit_pixel(false);
+    REQUIRE(three == expected);
+    REQUIRE(three.row_data(0)[0] == 0xA0);
+
+    REQUIRE_THROWS_AS(pnm::read_pbm_packed("test_rgba.pam"), std::runtime_error);
+}
+
+TEST_CASE("test pbm lines across kernel boundaries", "[pbm io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::bernoulli_distribution dist(0.5);
+
+    // the kernels process 16 or 32 bytes at once, then 1 byte, then the rest
+    for(const std::size_t width : {1u, 7u, 8u, 9u, 15u, 16u, 17u, 63u, 64u, 65u,
+                                   127u, 128u, 129u, 255u, 256u, 257u, 300u})
+    {
+        pnm::image<pnm::bit_pixel> img(width, 3);
+        for(auto& pix : img) {pix = pnm::bit_pixel(dist(mt));}
+
+        pnm::write_pbm_binary("test_kernel.pbm", img);
+        REQUIRE(img == pnm::read_pbm_binary("test_kernel.pbm"));
+        REQUIRE(pnm::packed_bit_image<>(img) ==
+                pnm::read_pbm_packed("test_kernel.pbm"));
+    }
+}
+
+TEST_CASE("test conversion while decoding", "[convert io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 255);
+
+    // large enough for the payload to be converted in several chunks
+    pnm::image<pnm::rgb_pixel> rgb(2000, 600);
+    for(auto& pix : rgb) {pix = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));}
+    const auto gray = pnm::convert_image<pnm::gray_pixel>(
+            pnm::const_image_view<pnm::rgb_pixel>(rgb), pnm::narrowing_policy());
+    const auto bit  = pnm::convert_image<pnm::bit_pixel>(
+            pnm::const_image_view<pnm::gray_pixel>(gray), pnm::narrowing_policy());
+
+    for(const auto fmt : {pnm::format::ascii, pnm::format::binary})
+    {
+        pnm::write("test_convert.pbm", bit,  fmt);
+        pnm::write("test_convert.pgm", gray, fmt);
+        pnm::write("test_convert.ppm", rgb,  fmt);
+
+        REQUIRE(pnm::read<pnm::rgb_pixel>("test_convert.pbm") ==
+                pnm::convert_image<pnm::rgb_pixel>(
+                    pnm::const_image_view<pnm::bit_pixel>(bit)));
+        REQUIRE(pnm::read<pnm::rgb16_pixel>("test_convert.pgm") ==
+                pnm::convert_image<pnm::rgb16_pixel>(
+                    pnm::const_image_view<pnm::gray16_pixel>(
+                        pnm::read<pnm::gray16_pixel>("test_convert.pgm"))));
+        REQUIRE(pnm::read<pnm::rgba_pixel>("test_convert.ppm") ==
+                pnm::convert_image<pnm::rgba_pixel>(
+                    pnm::const_image_view<pnm::rgb_pixel>(rgb)));
+    }
+
+    pnm::write_pam("test_convert.pam", gray);
+    REQUIRE(pnm::read_pam<pnm::rgb_pixel>("test_convert.pam") ==
+            pnm::convert_image<pnm::rgb_pixel>(
+                pnm::const_image_view<pnm::gray_pixel>(gray)));
+
+    // pfm rows are stored from bottom to top
+    const auto grayf = pnm::convert_image<pnm::grayf_pixel>(
+            pnm::const_image_view<pnm::gray_pixel>(gray));
+    pnm::write_pfm("test_convert.pfm", grayf);
+    REQUIRE(pnm::read_pfm<pnm::rgbf_pixel>("test_convert.pfm") ==
+            pnm::convert_image<pnm::rgbf_pixel>(
+                pnm::const_image_view<pnm::grayf_pixel>(grayf)));
+
+    // the identity conversion moves the image
+    auto moved = rgb;
+    const auto* const data = moved.data();
+    const auto same = pnm::convert_image<pnm::rgb_pixel,
+          std::allocator<pnm::rgb_pixel>>(std::move(moved));
+    REQUIRE(same.data() == data);
+}
+
+TEST_CASE("test read_into", "[read_into]")
+{
+    pnm::image<pnm::rgb_pixel> frame1(13, 7, pnm::rgb_pixel(1, 2, 3));
+    pnm::image<pnm::rgb_pixel> frame2(13, 7, pnm::rgb_pixel(4, 5, 6));
+    pnm::image<pnm::rgb_pixel> other (5, 3,  pnm::rgb_pixel(7, 8, 9));
+    pnm::write_ppm_binary("test_frame1.ppm", frame1);
+    pnm::write_ppm_ascii ("test_frame2.ppm", frame2);
+    pnm::write_ppm_binary("test_other.ppm",  other);
+
+    pnm::image<pnm::rgb_pixel> img;
+    const auto hdr = pnm::read_into("test_frame1.ppm", img);
+    REQUIRE(hdr.magic  == '6');
+    REQUIRE(hdr.width  == 13);
+    REQUIRE(hdr.height == 7);
+    REQUIRE(img == frame1);
+
+    // the buffer is reused if the size is the same
+    const auto* const data = img.data();
+    pnm::read_into("test_frame2.ppm", img);
+    REQUIRE(img == frame2);
+    REQUIRE(img.data() == data);
+
+    std::ifstream ifs("test_frame1.ppm", std::ios::binary);
+    pnm::read_into(ifs, img);
+    REQUIRE(img == frame1);
+    REQUIRE(img.data() == data);
+
+    // and resized otherwise
+    pnm::read_into("test_other.ppm", img);
+    REQUIRE(img == other);
+
+    // pixels are converted like read<Pixel>
+    pnm::image<pnm::gray16_pixel> gray;
+    const std::string pgm("P2\n2 1\n255\n0 255\n");
+    REQUIRE(pnm::read_into(pgm.data(), pgm.size(), gray).magic == '2');
+    REQUIRE(gray == pnm::read<pnm::gray16_pixel>(pgm.data(), pgm.size()));
+
+    REQUIRE_THROWS_AS(pnm::read_into("no_such_file.ppm", img), std::runtime_error);
+}
+
+TEST_CASE("test input/output of aligned_image", "[aligned io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 255);
+
+    pnm::image<pnm::rgb_pixel> rgb(37, 9);
+    for(auto& pix : rgb) {pix = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));}
+    const pnm::aligned_image<pnm::rgb_pixel, 32> aligned(rgb);
+
+    for(const auto fmt : {pnm::format::ascii, pnm::format::binary})
+    {
+        // the padding is not written
+        pnm::write("test_aligned.ppm", aligned, fmt);
+        REQUIRE(rgb == pnm::read_ppm("test_aligned.ppm"));
+
+        // and is kept while reading
+        pnm::aligned_image<pnm::rgb_pixel, 32> img;
+        const auto hdr = pnm::read_into("test_aligned.ppm", img);
+        REQUIRE(hdr.width == 37);
+        REQUIRE(img.stride() == aligned.stride());
+        REQUIRE(reinterpret_cast<std::uintptr_t>(img.row_ptr(1)) % 32 == 0);
+        REQUIRE(pnm::convert_image<pnm::rgb_pixel>(
+                    pnm::const_image_view<pnm::rgb_pixel>(img)) == rgb);
+
+        // converted while decoding
+        pnm::aligned_image<pnm::rgba_pixel> rgba;
+        pnm::read_into("test_aligned.ppm", rgba);
+        for(std::size_t j=0; j<rgb.height(); ++j)
+        {
+            for(std::size_t i=0; i<rgb.width(); ++i)
+            {
+                REQUIRE(rgba(i, j) == pnm::convert_to<pnm::rgba_pixel>(rgb(i, j)));
+            }
+        }
+    }
+
+    // pfm rows are stored from bottom to top
+    pnm::image<pnm::grayf_pixel> grayf(21, 5);
+    for(std::size_t i=0; i<grayf.size(); ++i)
+    {
+        grayf.raw_access(i) = pnm::grayf_pixel(static_cast<float>(i));
+    }
+    pnm::write_pfm("test_aligned.pfm", grayf);
+    pnm::aligned_image<pnm::grayf_pixel> img;
+    pnm::read_into("test_aligned.pfm", img);
+    REQUIRE(img.stride() == 32);
+    REQUIRE(pnm::convert_image<pnm::grayf_pixel>(
+                pnm::const_image_view<pnm::grayf_pixel>(img)) == grayf);
+}
+
+TEST_CASE("test parallel input of binary images", "[parallel io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 65535);
+    const pnm::parallel_policy par(4);
+
+    // large enough to be split into several bands; the height is not a
+    // multiple of the number of threads
+    pnm::image<pnm::rgb16_pixel> rgb16(1000, 1501);
+    for(auto& pix : rgb16) {pix = pnm::rgb16_pixel(dist(mt), dist(mt), dist(mt));}
+    pnm::image<pnm::rgb_pixel> rgb(1000, 1501);
+    for(auto& pix : rgb)
+    {
+        pix = pnm::rgb_pixel(dist(mt) & 0xFF, dist(mt) & 0xFF, dist(mt) & 0xFF);
+    }
+    pnm::image<pnm::bit_pixel> bit(8003, 2101);
+    for(auto& pix : bit) {pix = pnm::bit_pixel((dist(mt) & 1) != 0);}
+
+    pnm::write_ppm_binary("test_parallel.ppm",   rgb);
+    pnm::write_ppm_binary("test_parallel16.ppm", rgb16);
+    pnm::write_pbm_binary("test_parallel.pbm",   bit);
+    pnm::write_pam("test_parallel.pam", rgb);
+
+    REQUIRE(rgb   == pnm::read_ppm_binary("test_parallel.ppm", par));
+    REQUIRE(bit   == pnm::read_pbm_binary("test_parallel.pbm", par));
+    REQUIRE(rgb16 == pnm::read<pnm::rgb16_pixel>("test_parallel16.ppm", par));
+    REQUIRE(pnm::read<pnm::rgba_pixel>("test_parallel.pam", par) ==
+            pnm::read<pnm::rgba_pixel>("test_parallel.pam"));
+    REQUIRE(pnm::read<pnm::rgb_pixel>("test_parallel.pbm", pnm::parallel_policy()) ==
+            pnm::read<pnm::rgb_pixel>("test_parallel.pbm"));
+
+    // rescaled to 8-bit while decoding
+    REQUIRE(pnm::read<pnm::rgb_pixel>("test_parallel16.ppm", par) ==
+            pnm::read<pnm::rgb_pixel>("test_parallel16.ppm"));
+
+    // pfm rows are stored from bottom to top
+    const auto rgbf = pnm::convert_image<pnm::rgbf_pixel>(
+            pnm::const_image_view<pnm::rgb_pixel>(rgb));
+    pnm::write_pfm("test_parallel.pfm", rgbf);
+    REQUIRE(rgbf == pnm::read<pnm::rgbf_pixel>("test_parallel.pfm", par));
+
+    // into an aligned image
+    pnm::aligned_image<pnm::rgb_pixel> aligned;
+    REQUIRE(pnm::read_into("test_parallel.ppm", aligned, par).height == 1501);
+    REQUIRE(pnm::convert_image<pnm::rgb_pixel>(
+                pnm::const_image_view<pnm::rgb_pixel>(aligned)) == rgb);
+
+    // ascii files are parsed in chunks
+    pnm::write_ppm_ascii("test_parallel_ascii.ppm", rgb);
+    REQUIRE(rgb == pnm::read<pnm::rgb_pixel>("test_parallel_ascii.ppm", par));
+    REQUIRE(rgb == pnm::read_ppm_ascii("test_parallel_ascii.ppm", par));
+
+    // a truncated file is detected before decoding
+    {
+        std::ifstream ifs("test_parallel.ppm", std::ios::binary);
+        const std::string file((std::istreambuf_iterator<char>(ifs)),
+                                std::istreambuf_iterator<char>());
+        std::ofstream ofs("test_parallel_truncated.ppm", std::ios::binary);
+        ofs.write(file.data(), static_cast<std::streamsize>(file.size() - 1));
+    }
+    REQUIRE_THROWS_AS(pnm::read_ppm_binary("test_parallel_truncated.ppm", par),
+                      std::runtime_error);
+    REQUIRE_THROWS_AS(pnm::read_pgm_binary("test_parallel.ppm", par),
+                      std::runtime_error);
+}
+
+TEST_CASE("test parallel input of ascii images", "[parallel io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 65535);
+    const pnm::parallel_policy par(4);
+
+    // comments and line breaks appear anywhere between tokens
+    const std::size_t x = 1003, y = 997;
+    std::vector<std::uint16_t> values(x * y * 3);
+    for(auto& v : values) {v = dist(mt);}
+    const auto write_ascii = [&](const std::string& fname, const char magic,
+                                 const std::size_t colors, const std::size_t n,
+                                 const std::string& extra)
+    {
+        std::ofstream ofs(fname);
+        ofs << 'P' << magic << '\n' << x << ' ' << y << '\n';
+        if(magic != '1') {ofs << "65535\n";}
+        for(std::size_t i=0; i<n * colors; ++i)
+        {
+            const std::uint16_t v = (magic == '1') ? (values[i] & 1) : values[i];
+            switch(values[i] % 7)
+            {
+                case 0:  {ofs << v << "\n"; break;}
+                case 1:  {ofs << v << " # 1 2 3 #\n"; break;}
+                case 2:  {ofs << v << "#4\n\n"; break;}
+                default: {ofs << v << ' '; break;}
+            }
+        }
+        ofs << extra;
+    };
+
+    write_ascii("test_parallel_ascii.pbm", '1', 1, x * y, "");
+    write_ascii("test_parallel_ascii.pgm", '2', 1, x * y, "# end\n");
+    write_ascii("test_parallel_ascii16.ppm", '3', 3, x * y, "");
+    REQUIRE(pnm::read_pbm_ascii("test_parallel_ascii.pbm", par) ==
+            pnm::read_pbm_ascii("test_parallel_ascii.pbm"));
+    REQUIRE(pnm::read_pgm_ascii("test_parallel_ascii.pgm", par) ==
+            pnm::read_pgm_ascii("test_parallel_ascii.pgm"));
+    REQUIRE(pnm::read<pnm::rgb16_pixel>("test_parallel_ascii16.ppm", par) ==
+            pnm::read<pnm::rgb16_pixel>("test_parallel_ascii16.ppm"));
+    REQUIRE(pnm::read<pnm::rgb_pixel>("test_parallel_ascii16.ppm", par) ==
+            pnm::read<pnm::rgb_pixel>("test_parallel_ascii16.ppm"));
+
+    // missing pixels are filled with the default value, even in a reused image
+    write_ascii("test_parallel_missing.ppm", '3', 3, x * y - 1000, "1 2\n");
+    pnm::image<pnm::rgb16_pixel> img(x, y, pnm::rgb16_pixel(1, 1, 1));
+    pnm::read_into("test_parallel_missing.ppm", img, par);
+    REQUIRE(img == pnm::read<pnm::rgb16_pixel>("test_parallel_missing.ppm"));
+    REQUIRE(img(x - 1, y - 1) == pnm::rgb16_pixel(0, 0, 0));
+
+    write_ascii("test_parallel_toomany.pgm", '2', 1, x * y, "1\n");
+    REQUIRE_THROWS_AS(pnm::read_pgm_ascii("test_parallel_toomany.pgm", par),
+                      std::runtime_error);
+    write_ascii("test_parallel_invalid.pgm", '2', 1, x * y / 2, "12a ");
+    REQUIRE_THROWS_AS(pnm::read_pgm_ascii("test_parallel_invalid.pgm", par),
+                      std::runtime_error);
+    REQUIRE_THROWS_AS(pnm::read_ppm_ascii("test_parallel_ascii.pgm", par),
+                      std::runtime_error);
+}
+
+TEST_CASE("test parallel output of binary images", "[parallel io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 65535);
+    const pnm::parallel_policy par(4);
+
+    const auto read_file = [](const std::string& fname) {
+        std::ifstream ifs(fname, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(ifs)),
+                            std::istreambuf_iterator<char>());
+    };
+
+    pnm::image<pnm::rgb16_pixel> rgb16(1000, 1501);
+    for(auto& pix : rgb16) {pix = pnm::rgb16_pixel(dist(mt), dist(mt), dist(mt));}
+    pnm::image<pnm::gray16_pixel> gray16(1000, 1501);
+    for(auto& pix : gray16) {pix = pnm::gray16_pixel(dist(mt));}
+    pnm::image<pnm::rgb_pixel> rgb(1000, 1501);
+    for(auto& pix : rgb)
+    {
+        pix = pnm::rgb_pixel(dist(mt) & 0xFF, dist(mt) & 0xFF, dist(mt) & 0xFF);
+    }
+    pnm::image<pnm::gray_pixel> gray(3001, 1501);
+    for(auto& pix : gray) {pix = pnm::gray_pixel(dist(mt) & 0xFF);}
+    pnm::image<pnm::bit_pixel> bit(8003, 2101);
+    for(auto& pix : bit) {pix = pnm::bit_pixel((dist(mt) & 1) != 0);}
+
+    // the files are the same as the ones written serially
+    pnm::write_ppm_binary("test_parallel_out.ppm",   rgb,    par);
+    pnm::write_ppm_binary("test_parallel_out16.ppm", rgb16,  par);
+    pnm::write_pgm_binary("test_parallel_out.pgm",   gray,   par);
+    pnm::write_pgm_binary("test_parallel_out16.pgm", gray16, par);
+    pnm::write_pbm_binary("test_parallel_out.pbm",   bit,    par);
+    pnm::write_ppm_binary("test_serial_out.ppm",   rgb);
+    pnm::write_ppm_binary("test_serial_out16.ppm", rgb16);
+    pnm::write_pgm_binary("test_serial_out.pgm",   gray);
+    pnm::write_pgm_binary("test_serial_out16.pgm", gray16);
+    pnm::write_pbm_binary("test_serial_out.pbm",   bit);
+
+    REQUIRE(read_file("test_parallel_out.ppm")   == read_file("test_serial_out.ppm"));
+    REQUIRE(read_file("test_parallel_out16.ppm") == read_file("test_serial_out16.ppm"));
+    REQUIRE(read_file("test_parallel_out.pgm")   == read_file("test_serial_out.pgm"));
+    REQUIRE(read_file("test_parallel_out16.pgm") == read_file("test_serial_out16.pgm"));
+    REQUIRE(read_file("test_parallel_out.pbm")   == read_file("test_serial_out.pbm"));
+    REQUIRE(bit == pnm::read_pbm_binary("test_parallel_out.pbm"));
+
+    // a shorter file is truncated
+    pnm::write_pgm_binary("test_parallel_out.ppm", gray, par);
+    REQUIRE(read_file("test_parallel_out.ppm") == read_file("test_serial_out.pgm"));
+
+    // a view that is not contiguous, and an aligned image
+    const auto sub = pnm::const_image_view<pnm::rgb_pixel>(rgb).subview(1, 1, 997, 1499);
+    pnm::write("test_parallel_sub.ppm", sub, pnm::format::binary, par);
+    pnm::write("test_serial_sub.ppm",   sub, pnm::format::binary);
+    REQUIRE(read_file("test_parallel_sub.ppm") == read_file("test_serial_sub.ppm"));
+
+    const pnm::aligned_image<pnm::rgb_pixel> aligned(rgb);
+    pnm::write("test_parallel_aligned.ppm", aligned, pnm::format::binary, par);
+    REQUIRE(read_file("test_parallel_aligned.ppm") == read_file("test_serial_out.ppm"));
+
+    // ascii files are written serially
+    pnm::write("test_parallel_out_ascii.ppm", rgb, pnm::format::ascii, par);
+    REQUIRE(rgb == pnm::read_ppm_ascii("test_parallel_out_ascii.ppm"));
+
+    REQUIRE_THROWS_AS(pnm::write_ppm_binary("no_such_dir/out.ppm", rgb, par),
+                      std::runtime_error);
+}
+
+TEST_CASE("test batch input/output", "[batch io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::size_t> size(1, 64);
+    std::uniform_int_distribution<std::uint16_t> dist(0, 255);
+    const pnm::parallel_policy par(4);
+
+    std::vector<pnm::image<pnm::rgb_pixel>> imgs;
+    std::vector<pnm::write_batch_item<pnm::rgb_pixel>> items;
+    for(std::size_t i=0; i<50; ++i)
+    {
+        pnm::image<pnm::rgb_pixel> img(size(mt), size(mt));
+        for(auto& pix : img) {pix = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));}
+        imgs.push_back(std::move(img));
+    }
+    for(std::size_t i=0; i<imgs.size(); ++i)
+    {
+        items.push_back({"test_batch_" + std::to_string(i) + ".ppm", imgs[i],
+                         (i % 3 == 0) ? pnm::format::ascii : pnm::format::binary});
+    }
+    items.push_back({"no_such_dir/test_batch.ppm", imgs.front(), pnm::format::binary});
+
+    pnm::batch_stats stats;
+    const auto errors = pnm::write_batch(items, par, &stats);
+    REQUIRE(errors.size() == items.size());
+    for(std::size_t i=0; i<imgs.size(); ++i)
+    {
+        REQUIRE(!errors[i]);
+    }
+    REQUIRE(errors.back());
+    REQUIRE_THROWS_AS(std::rethrow_exception(errors.back()), std::runtime_error);
+    REQUIRE(stats.files  == items.size());
+    REQUIRE(stats.failed == 1);
+
+    std::vector<std::string> fnames;
+    for(std::size_t i=0; i<imgs.size(); ++i)
+    {
+        fnames.push_back(items[i].fname);
+        if(i == 10) {fnames.push_back("no_such_file.ppm");}
+    }
+
+    // the results are in the same order as the file names
+    const auto results = pnm::read_batch(fnames, par, &stats);
+    REQUIRE(results.size() == fnames.size());
+    for(std::size_t i=0, j=0; i<results.size(); ++i)
+    {
+        if(fnames[i] == "no_such_file.ppm")
+        {
+            REQUIRE(results[i].error);
+            REQUIRE_THROWS_AS(std::rethrow_exception(results[i].error),
+                              std::runtime_error);
+            continue;
+        }
+        REQUIRE(!results[i].error);
+        REQUIRE(results[i].img == imgs.at(j++));
+    }
+    std::size_t pixels = 0;
+    for(const auto& img : imgs) {pixels += img.size();}
+    REQUIRE(stats.files  == fnames.size());
+    REQUIRE(stats.failed == 1);
+    REQUIRE(stats.pixels == pixels);
+    REQUIRE(stats.seconds >= 0.0);
+
+    // a serial pool gives the same results
+    const auto serial = pnm::read_batch<pnm::gray_pixel>(
+            std::vector<std::string>{"test_batch_1.ppm"}, pnm::parallel_policy(1));
+    REQUIRE(serial.size() == 1);
+    REQUIRE(serial.front().error); // narrowing conversion is not allowed
+    REQUIRE(pnm::read_batch(std::vector<std::string>{}, par).empty());
+}
+
+namespace
+{
+// runs the tasks on the calling thread and counts them.
+struct counting_executor final : public pnm::executor
+{
+    std::size_t concurrency() const noexcept override {return 4;}
+    void execute(const std::size_t n,
+                 const std::function<void(std::size_t)>& task) override
+    {
+        for(std::size_t i=0; i<n; ++i) {task(i);}
+        tasks += n;
+    }
+    std::size_t tasks = 0;
+};
+} // anonymous
+
+TEST_CASE("test parallel input/output on an executor", "[parallel io]")
+{
+    std::random_device dev;
+    std::mt19937 mt(dev());
+    std::uniform_int_distribution<std::uint16_t> dist(0, 255);
+
+    pnm::image<pnm::rgb_pixel> rgb(1000, 1501);
+    for(auto& pix : rgb) {pix = pnm::rgb_pixel(dist(mt), dist(mt), dist(mt));}
+
+    // the tasks run on the executor passed by the caller
+    counting_executor counter;
+    pnm::write_ppm_binary("test_executor.ppm", rgb, counter);
+    REQUIRE(counter.tasks == 5); // a header and 4 bands
+    REQUIRE(rgb == pnm::read_ppm_binary("test_executor.ppm", counter));
+    REQUIRE(counter.tasks == 9);
+
+    pnm::write("test_executor_ascii.ppm", rgb, pnm::format::ascii);
+    REQUIRE(rgb == pnm::read<pnm::rgb_pixel>("test_executor_ascii.ppm", counter));
+    REQUIRE(counter.tasks > 9);
+
+    // an inline executor runs everything on the calling thread
+    pnm::inline_executor serial;
+    pnm::write("test_executor_serial.ppm", rgb, pnm::format::binary, serial);
+    REQUIRE(rgb == pnm::read<pnm::rgb_pixel>("test_executor_serial.ppm", serial));
+
+    pnm::thread_pool pool(3);
+    pnm::image<pnm::rgb_pixel> img;
+    pnm::read_into("test_executor.ppm", img, pnm::parallel_policy(pool, 8));
+    REQUIRE(rgb == img);
+    REQUIRE(rgb == pnm::read_ppm_ascii("test_executor_ascii.ppm", pool));
+
+    const auto results = pnm::read_batch(std::vector<std::string>{
+            "test_executor.ppm", "test_executor_serial.ppm"}, pool);
+    REQUIRE(results.size() == 2);
+    REQUIRE(rgb == results[0].img);
+    REQUIRE(rgb == results[1].img);
+}
@@ -158,4 +158,67 @@ TEST_CASE("conversion between pixel types", "[convert pixel]")
         REQUIRE(c3.green == 255);
         REQUIRE(c3.blue  == 255);
     }
+
+    SECTION("8-bit <-> 16-bit")
+    {
+        const pnm::gray_pixel g(128);
+        const auto g16 = pnm::convert_to<pnm::gray16_pixel>(g);
+        REQUIRE(g16.value == 128 * 257);
+        REQUIRE(pnm::convert_to<pnm::gray_pixel>(g16).value == 128);
+
+        const pnm::rgb_pixel c(0, 1, 255);
+        const auto c16 = pnm::convert_to<pnm::rgb16_pixel>(c);
+        REQUIRE(c16.red   ==     0);
+        REQUIRE(c16.green ==   257);
+        REQUIRE(c16.blue  == 65535);
+        REQUIRE(pnm::convert_to<pnm::rgb_pixel>(c16) == c);
+
+        const auto w16 = pnm::convert_to<pnm::rgb16_pixel>(pnm::bit_pixel(false));
+        REQUIRE(w16 == pnm::rgb16_pixel(65535, 65535, 65535));
+        REQUIRE(pnm::convert_to<pnm::rgb16_pixel>(g16) ==
+                pnm::rgb16_pixel(g16.value, g16.value, g16.value));
+
+        REQUIRE_THROWS(pnm::convert_to<pnm::gray16_pixel>(c16));
+    }
+
+    SECTION("narrowing conversion with a policy")
+    {
+        REQUIRE_THROWS(pnm::convert_to<pnm::gray_pixel>(pnm::rgb_pixel(255, 0, 0)));
+
+        const pnm::narrowing_policy bt601;
+        const pnm::narrowing_policy bt709(pnm::luminance::bt709, 100);
+        REQUIRE(pnm::convert_to<pnm::gray_pixel>(pnm::rgb_pixel(255, 0, 0), bt601).value ==  76);
+        REQUIRE(pnm::convert_to<pnm::gray_pixel>(pnm::rgb_pixel(0, 255, 0), bt601).value == 150);
+        REQUIRE(pnm::convert_to<pnm::gray_pixel>(pnm::rgb_pixel(0, 255, 0), bt709).value == 182);
+        REQUIRE(pnm::convert_to<pnm::gray_pixel>(pnm::rgb_pixel(255, 255, 255), bt709).value == 255);
+
+        // darker than the threshold becomes black
+        REQUIRE(pnm::convert_to<pnm::bit_pixel>(pnm::gray_pixel(127), bt601).value == true);
+        REQUIRE(pnm::convert_to<pnm::bit_pixel>(pnm::gray_pixel(128), bt601).value == false);
+        REQUIRE(pnm::convert_to<pnm::bit_pixel>(pnm::gray_pixel(99),  bt709).value == true);
+        REQUIRE(pnm::convert_to<pnm::bit_pixel>(pnm::gray_pixel(100), bt709).value == false);
+        REQUIRE(pnm::convert_to<pnm::bit_pixel>(pnm::rgb_pixel(0, 255, 0), bt601).value == false);
+        REQUIRE(pnm::convert_to<pnm::bit_pixel>(pnm::rgb_pixel(255, 0, 0), bt601).value == true);
+
+        // other conversions are not affected
+        REQUIRE(pnm::convert_to<pnm::rgb_pixel>(pnm::gray_pixel(10), bt601) ==
+                pnm::rgb_pixel(10, 10, 10));
+    }
+
+    SECTION("pixels with alpha")
+    {
+        const pnm::rgba_pixel c = pnm::convert_to<pnm::rgba_pixel>(pnm::rgb_pixel(1, 2, 3));
+        REQUIRE(c.red   ==   1);
+        REQUIRE(c.green ==   2);
+        REQUIRE(c.blue  ==   3);
+        REQUIRE(c.alpha == 255);
+
+        const pnm::gray_alpha_pixel g = pnm::convert_to<pnm::gray_alpha_pixel>(pnm::bit_pixel(true));
+        REQUIRE(g.value ==   0);
+        REQUIRE(g.alpha == 255);
+        REQUIRE(pnm::convert_to<pnm::rgba_pixel>(pnm::gray_alpha_pixel(10, 20)) ==
+                pnm::rgba_pixel(10, 10, 10, 20));
+        REQUIRE(pnm::convert_to<pnm::rgba16_pixel>(pnm::rgb16_pixel(1, 2, 3)) ==
+                pnm::rgba16_pixel(1, 2, 3, 65535));
+    }
 }